@@ -0,0 +1,60 @@
+// Host microbenchmark: the old std::filesystem + std::regex /proc walk against
+// the getdents64 scanner in procfs.h.
+//
+//   cmake -S . -B build -DTASKMANAGERD_BUILD_BENCHMARKS=ON
+//   cmake --build build --target listpids_bench && build/listpids_bench [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "../procfs.h"
+
+namespace fs = std::filesystem;
+
+static std::regex pid_regex("\\d+");
+
+static std::vector<int> listPidsLegacy() {
+    std::vector<int> pids;
+    pids.reserve(256);
+    for (const auto &entry : fs::directory_iterator("/proc")) {
+        try {
+            if (entry.is_directory()) {
+                std::string name = entry.path().filename();
+                if (std::regex_match(name, pid_regex)) {
+                    pids.push_back(std::stoi(name));
+                }
+            }
+        } catch (...) {}
+    }
+    return pids;
+}
+
+template <typename Fn>
+static double timeUs(int iterations, Fn &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+    if (iterations <= 0) iterations = 2000;
+
+    size_t legacyCount = 0;
+    double legacyUs = timeUs(iterations, [&] { legacyCount = listPidsLegacy().size(); });
+
+    std::vector<int> pids;
+    double scannerUs = timeUs(iterations, [&] { listPids(pids); });
+
+    printf("pids: legacy=%zu getdents64=%zu\n", legacyCount, pids.size());
+    printf("legacy (filesystem + regex): %8.2f us/call\n", legacyUs);
+    printf("getdents64 scanner:          %8.2f us/call\n", scannerUs);
+    printf("speedup:                     %8.2fx\n", legacyUs / scannerUs);
+    return 0;
+}
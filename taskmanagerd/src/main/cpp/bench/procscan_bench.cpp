@@ -0,0 +1,58 @@
+// Host microbenchmark: how a full /proc scan scales with the number of
+// threads in WorkerPool. Each PID gets the same reads readProc does for a
+// default LIST_PROCESS (stat, status, comm, cmdline, cgroup, exe, oom_score_adj).
+//
+//   cmake -S . -B build -DTASKMANAGERD_BUILD_BENCHMARKS=ON
+//   cmake --build build --target procscan_bench && build/procscan_bench [iterations] [max threads]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../procfs.h"
+#include "../worker_pool.h"
+
+static size_t scanPid(int pid) {
+    static const char *const files[] = {"stat", "status", "comm", "cmdline", "cgroup", "oom_score_adj"};
+    char path[64];
+    char buf[4096];
+    size_t bytes = 0;
+    for (const char *file : files) {
+        snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+        ssize_t len = readSmallFile(AT_FDCWD, path, buf, sizeof(buf));
+        if (len > 0) bytes += static_cast<size_t>(len);
+    }
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+    ssize_t len = readlink(path, buf, sizeof(buf));
+    if (len > 0) bytes += static_cast<size_t>(len);
+    return bytes;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+    if (iterations <= 0) iterations = 200;
+    unsigned maxThreads = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+
+    std::vector<int> pids;
+    listPids(pids);
+    std::vector<size_t> slots(pids.size());
+    printf("pids: %zu, hardware threads: %u\n", pids.size(), std::thread::hardware_concurrency());
+
+    double baseUs = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        WorkerPool pool(threads - 1);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            pool.parallelFor(pids.size(), [&](size_t j) { slots[j] = scanPid(pids[j]); });
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double us = std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+        if (threads == 1) baseUs = us;
+        printf("%2u thread(s): %9.1f us/scan  %5.2fx\n", threads, us, baseUs / us);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Host microbenchmark: the std::ifstream probes the daemon used to run against
+// readSmallFile() and the allocation-free parsers in procfs.h.
+//
+//   cmake -S . -B build -DTASKMANAGERD_BUILD_BENCHMARKS=ON
+//   cmake --build build --target smallfile_bench && build/smallfile_bench [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "../procfs.h"
+
+static long uptimeLegacy() {
+    std::ifstream uptime("/proc/uptime");
+    double seconds = 0.0;
+    if (uptime.is_open()) uptime >> seconds;
+    return static_cast<long>(seconds * 100);
+}
+
+static long uptimeSmallFile() {
+    std::string_view text;
+    if (!readSmallFile(AT_FDCWD, "/proc/uptime", text)) return 0;
+    const char *end = text.data() + text.size();
+    unsigned long long seconds = 0, centis = 0;
+    const char *p = parseUnsigned(text.data(), end, seconds);
+    if (p < end && *p == '.') parseUnsigned(p + 1, std::min(p + 3, end), centis);
+    return static_cast<long>(seconds * 100 + centis);
+}
+
+static long swapLegacy() {
+    std::ifstream meminfo("/proc/meminfo");
+    long totalKB = 0, freeKB = 0;
+    std::string line;
+    while (std::getline(meminfo, line)) {
+        if (line.compare(0, 10, "SwapTotal:") == 0) totalKB = std::stol(line.substr(10));
+        else if (line.compare(0, 9, "SwapFree:") == 0) freeKB = std::stol(line.substr(9));
+    }
+    return totalKB - freeKB;
+}
+
+static long swapSmallFile() {
+    std::string_view text;
+    if (!readSmallFile(AT_FDCWD, "/proc/meminfo", text)) return 0;
+    return (long)(parseLeadingInt(findKeyValue(text, "SwapTotal"), 0) - parseLeadingInt(findKeyValue(text, "SwapFree"), 0));
+}
+
+static long oomLegacy() {
+    std::ifstream oomFile("/proc/self/oom_score_adj");
+    int score = 0;
+    oomFile >> score;
+    return score;
+}
+
+static long oomSmallFile() {
+    std::string_view text;
+    if (!readSmallFile(AT_FDCWD, "/proc/self/oom_score_adj", text)) return 0;
+    return (long)parseLeadingInt(text, 0);
+}
+
+static long commLegacy() {
+    std::ifstream commFile("/proc/self/comm");
+    std::string name;
+    std::getline(commFile, name);
+    return (long)name.size();
+}
+
+static long commSmallFile() {
+    std::string_view text;
+    if (!readSmallFile(AT_FDCWD, "/proc/self/comm", text)) return 0;
+    return (long)firstLine(text).size();
+}
+
+template <typename Fn>
+static double timeUs(int iterations, Fn &&fn, long &result) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) result = fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+template <typename Legacy, typename Fast>
+static void compare(const char *label, int iterations, Legacy &&legacy, Fast &&fast) {
+    long a = 0, b = 0;
+    double legacyUs = timeUs(iterations, legacy, a);
+    double fastUs = timeUs(iterations, fast, b);
+    printf("%-14s ifstream %7.2f us  readSmallFile %7.2f us  %5.2fx  (%ld / %ld)\n",
+           label, legacyUs, fastUs, legacyUs / fastUs, a, b);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    if (iterations <= 0) iterations = 20000;
+
+    compare("uptime", iterations, uptimeLegacy, uptimeSmallFile);
+    compare("meminfo swap", iterations, swapLegacy, swapSmallFile);
+    compare("oom_score_adj", iterations, oomLegacy, oomSmallFile);
+    compare("comm", iterations, commLegacy, commSmallFile);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+// Streaming JSON writer for large replies. Values are appended straight into
+// a reusable buffer that is handed to the sink whenever it grows past a
+// threshold, so a long process list never exists as a DOM or as one big
+// string.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+class JsonWriter {
+public:
+    // Receives each chunk; returns false once output is no longer possible.
+    using Sink = bool (*)(const char *data, size_t size);
+
+    explicit JsonWriter(Sink sink, size_t flushThreshold = 64 * 1024)
+        : sink_(sink), flushThreshold_(flushThreshold) {
+        buf_.reserve(flushThreshold_ + 4096);
+    }
+
+    // Starts a new message, dropping anything left from a failed one.
+    void reset() {
+        buf_.clear();
+        needComma_ = false;
+        failed_ = false;
+    }
+
+    void beginObject() { separate(); buf_.push_back('{'); needComma_ = false; }
+    void endObject() { buf_.push_back('}'); needComma_ = true; maybeFlush(); }
+    void beginArray() { separate(); buf_.push_back('['); needComma_ = false; }
+    void endArray() { buf_.push_back(']'); needComma_ = true; maybeFlush(); }
+
+    void key(const char *k) {
+        separate();
+        buf_.push_back('"');
+        buf_.append(k);
+        buf_.append("\":", 2);
+        needComma_ = false;
+    }
+
+    void value(bool v) { separate(); buf_.append(v ? "true" : "false"); needComma_ = true; }
+    void value(int v) { value(static_cast<long long>(v)); }
+    void value(long v) { value(static_cast<long long>(v)); }
+    void value(unsigned long long v) { appendf("%llu", v); }
+    void value(long long v) { appendf("%lld", v); }
+    void value(double v) {
+        if (!std::isfinite(v)) { separate(); buf_.append("null"); needComma_ = true; return; }
+        appendf("%.17g", v);
+    }
+    void value(float v) {
+        if (!std::isfinite(v)) { separate(); buf_.append("null"); needComma_ = true; return; }
+        appendf("%.9g", static_cast<double>(v));
+    }
+    void value(const char *s) { value(s, strlen(s)); }
+    void value(const std::string &s) { value(s.data(), s.size()); }
+
+    void value(const char *s, size_t n) {
+        separate();
+        buf_.push_back('"');
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = static_cast<unsigned char>(s[i]);
+            switch (c) {
+                case '"': buf_.append("\\\""); break;
+                case '\\': buf_.append("\\\\"); break;
+                case '\n': buf_.append("\\n"); break;
+                case '\r': buf_.append("\\r"); break;
+                case '\t': buf_.append("\\t"); break;
+                default:
+                    if (c < 0x20) {
+                        char esc[8];
+                        snprintf(esc, sizeof(esc), "\\u%04x", c);
+                        buf_.append(esc);
+                    } else {
+                        buf_.push_back(static_cast<char>(c));
+                    }
+            }
+        }
+        buf_.push_back('"');
+        needComma_ = true;
+    }
+
+    template <typename T>
+    void field(const char *k, const T &v) { key(k); value(v); }
+
+    // Terminates the message with a newline and writes out what is left.
+    bool finishLine() {
+        buf_.push_back('\n');
+        flush();
+        return !failed_;
+    }
+
+private:
+    void separate() {
+        if (needComma_) buf_.push_back(',');
+    }
+
+    template <typename T>
+    void appendf(const char *fmt, T v) {
+        separate();
+        char tmp[32];
+        int n = snprintf(tmp, sizeof(tmp), fmt, v);
+        if (n > 0) buf_.append(tmp, static_cast<size_t>(n));
+        needComma_ = true;
+    }
+
+    void maybeFlush() {
+        if (buf_.size() >= flushThreshold_) flush();
+    }
+
+    void flush() {
+        if (!failed_ && !buf_.empty() && !sink_(buf_.data(), buf_.size())) failed_ = true;
+        buf_.clear();
+    }
+
+    Sink sink_;
+    size_t flushThreshold_;
+    std::string buf_;
+    bool needComma_ = false;
+    bool failed_ = false;
+};
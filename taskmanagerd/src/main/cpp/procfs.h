@@ -0,0 +1,216 @@
+#pragma once
+
+// Low-level helpers for reading procfs/sysfs without iostreams or heap
+// allocation on the hot path.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+static inline const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+static inline const char *parseUnsigned(const char *p, const char *end, unsigned long long &out) {
+    unsigned long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    out = v;
+    return p;
+}
+
+static inline const char *parseSigned(const char *p, const char *end, long long &out) {
+    bool negative = p < end && *p == '-';
+    if (negative) ++p;
+    unsigned long long v;
+    p = parseUnsigned(p, end, v);
+    out = negative ? -(long long)v : (long long)v;
+    return p;
+}
+
+// Size of the per-thread buffer behind the view-returning readSmallFile. Big
+// enough for /proc/stat and /proc/net/dev on phones with many interfaces;
+// anything longer is truncated.
+static constexpr size_t SMALL_FILE_BUFFER_SIZE = 16384;
+
+// Reads an open file from offset 0 into buf and NUL-terminates it.
+static inline ssize_t preadSmallFile(int fd, char *buf, size_t size) {
+    ssize_t len;
+    do {
+        len = pread(fd, buf, size - 1, 0);
+    } while (len < 0 && errno == EINTR);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// Reads a small procfs/sysfs file into buf with one pread() and NUL-terminates
+// it. name is resolved against dirfd, so pass AT_FDCWD for an absolute path.
+// procfs and sysfs hand back as much as fits in a single read, so there is no
+// read loop. Returns the number of bytes read, or -1 on failure.
+static inline ssize_t readSmallFile(int dirfd, const char *name, char *buf, size_t size) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t len = preadSmallFile(fd, buf, size);
+    close(fd);
+    return len;
+}
+
+static inline char *smallFileBuffer() {
+    static thread_local char buf[SMALL_FILE_BUFFER_SIZE];
+    return buf;
+}
+
+// Re-reads a file that is kept open from offset 0 into the thread-local
+// buffer. procfs and sysfs regenerate the contents on every read at offset 0,
+// so a held fd samples current values without another open.
+static inline bool preadSmallFile(int fd, std::string_view &out) {
+    ssize_t len = preadSmallFile(fd, smallFileBuffer(), SMALL_FILE_BUFFER_SIZE);
+    if (len < 0) return false;
+    out = std::string_view(smallFileBuffer(), static_cast<size_t>(len));
+    return true;
+}
+
+// Same as the buffer version, into a thread-local buffer so callers need no
+// storage of their own. out stays valid until the calling thread's next
+// readSmallFile or preadSmallFile.
+static inline bool readSmallFile(int dirfd, const char *name, std::string_view &out) {
+    ssize_t len = readSmallFile(dirfd, name, smallFileBuffer(), SMALL_FILE_BUFFER_SIZE);
+    if (len < 0) return false;
+    out = std::string_view(smallFileBuffer(), static_cast<size_t>(len));
+    return true;
+}
+
+// A procfs/sysfs file opened once and then sampled with preadSmallFile from
+// offset 0, so a hot metric costs one syscall instead of open/read/close.
+// The path is opened lazily; a failed read drops the fd and reopens the path
+// once (sysfs nodes come and go with hotplug and driver reloads).
+class MetricSource {
+public:
+    MetricSource() = default;
+    explicit MetricSource(std::string path) : path_(std::move(path)) {}
+    ~MetricSource() { close(); }
+
+    MetricSource(MetricSource &&other) noexcept : path_(std::move(other.path_)), fd_(other.fd_) { other.fd_ = -1; }
+    MetricSource &operator=(MetricSource &&other) noexcept {
+        if (this != &other) {
+            close();
+            path_ = std::move(other.path_);
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+    MetricSource(const MetricSource &) = delete;
+    MetricSource &operator=(const MetricSource &) = delete;
+
+    const std::string &path() const { return path_; }
+
+    // Current contents in the thread-local buffer, as with preadSmallFile.
+    bool sample(std::string_view &out) {
+        if (path_.empty()) return false;
+        if (fd_ >= 0 && preadSmallFile(fd_, out)) return true;
+        close();
+        fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        return fd_ >= 0 && preadSmallFile(fd_, out);
+    }
+
+    void close() {
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+};
+
+// First line of text, without its newline.
+static inline std::string_view firstLine(std::string_view text) {
+    size_t nl = text.find('\n');
+    return nl == std::string_view::npos ? text : text.substr(0, nl);
+}
+
+// Value of a "Key:   value" line (status, meminfo), with leading blanks
+// skipped; an empty view when the key is missing.
+static inline std::string_view findKeyValue(std::string_view text, std::string_view key) {
+    for (size_t pos = 0; pos < text.size();) {
+        size_t nl = text.find('\n', pos);
+        std::string_view line = text.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+        if (line.size() > key.size() && line[key.size()] == ':' && line.compare(0, key.size(), key) == 0) {
+            line.remove_prefix(key.size() + 1);
+            while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) line.remove_prefix(1);
+            return line;
+        }
+        if (nl == std::string_view::npos) break;
+        pos = nl + 1;
+    }
+    return {};
+}
+
+// Leading (optionally signed) integer of text; def when there are no digits.
+static inline long long parseLeadingInt(std::string_view text, long long def) {
+    const char *p = skipSpaces(text.data(), text.data() + text.size());
+    const char *end = text.data() + text.size();
+    const char *digits = p < end && *p == '-' ? p + 1 : p;
+    if (digits == end || *digits < '0' || *digits > '9') return def;
+    long long v;
+    parseSigned(p, end, v);
+    return v;
+}
+
+// Opens /proc/<pid> as a directory for openat-relative reads of its files.
+static inline int openProcDir(int pid) {
+    char path[24];
+    snprintf(path, sizeof(path), "/proc/%d", pid);
+    return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Layout of the records returned by getdents64(2).
+struct ProcDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Fills pids with every numeric directory in /proc. Walks the directory with
+// raw getdents64 and trusts d_type, so there is no stat() per entry; the
+// vector is cleared but keeps its capacity between calls.
+static inline bool listPids(std::vector<int> &pids) {
+    pids.clear();
+    int fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    alignas(ProcDirent64) char buf[32768];
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+
+        for (long off = 0; off < n;) {
+            auto *d = reinterpret_cast<ProcDirent64 *>(buf + off);
+            off += d->d_reclen;
+            if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN) continue;
+
+            const char *name = d->d_name;
+            if (*name < '1' || *name > '9') continue;
+            int pid = 0;
+            while (*name >= '0' && *name <= '9') pid = pid * 10 + (*name++ - '0');
+            if (*name == '\0') pids.push_back(pid);
+        }
+    }
+
+    close(fd);
+    return true;
+}
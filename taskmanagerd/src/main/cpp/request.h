@@ -0,0 +1,212 @@
+#pragma once
+
+// Allocation-free scanner for incoming request lines. Requests are flat JSON
+// objects whose members are almost always scalars, so instead of building a
+// DOM the scanner records where each top-level member's value starts and ends.
+// Only array/object values (or strings with escapes) are handed to the full
+// parser, and only that span of the line.
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "json.hpp"
+
+class RequestScanner {
+public:
+    static constexpr size_t MAX_MEMBERS = 16;
+
+    explicit RequestScanner(std::string_view text) { ok_ = scan(text); }
+
+    bool ok() const { return ok_; }
+
+    bool has(std::string_view key) const { return find(key) != nullptr; }
+
+    // String value as a view into the request, for keys whose values never
+    // need unescaping (command names, package names). Returns def when the
+    // key is missing, not a string, or contains escapes.
+    std::string_view str(std::string_view key, std::string_view def = {}) const {
+        const Member *m = find(key);
+        if (!m || m->kind != '"' || m->escaped) return def;
+        return m->value.substr(1, m->value.size() - 2);
+    }
+
+    // Decoded string value; falls back to the JSON parser for escapes.
+    std::string string(std::string_view key, const std::string &def = {}) const {
+        const Member *m = find(key);
+        if (!m || m->kind != '"') return def;
+        if (!m->escaped) return std::string(m->value.substr(1, m->value.size() - 2));
+        return nlohmann::json::parse(m->value.begin(), m->value.end()).get<std::string>();
+    }
+
+    // Integer value; a fractional part is truncated. Values with an exponent
+    // or that do not fit in a long long return def.
+    long long integer(std::string_view key, long long def) const {
+        const Member *m = find(key);
+        if (!m || m->kind != '0') return def;
+        const char *p = m->value.data();
+        const char *end = p + m->value.size();
+        bool negative = *p == '-';
+        if (negative) ++p;
+        long long v = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            int digit = *p++ - '0';
+            if (v > (LLONG_MAX - digit) / 10) return def;
+            v = v * 10 + digit;
+        }
+        if (p < end && *p != '.') return def;
+        return negative ? -v : v;
+    }
+
+    bool boolean(std::string_view key, bool def) const {
+        const Member *m = find(key);
+        if (!m || m->kind != 't') return def;
+        return m->value == "true";
+    }
+
+    // Full parse of a single member's value; null when the key is missing.
+    nlohmann::json parse(std::string_view key) const {
+        const Member *m = find(key);
+        if (!m) return nlohmann::json();
+        return nlohmann::json::parse(m->value.begin(), m->value.end());
+    }
+
+private:
+    struct Member {
+        std::string_view key;
+        std::string_view value;
+        // '"' string, '0' number, 't' true/false, 'n' null, '[' or '{' nested.
+        char kind;
+        bool escaped;
+    };
+
+    const Member *find(std::string_view key) const {
+        for (size_t i = 0; i < count_; ++i) {
+            if (members_[i].key == key) return &members_[i];
+        }
+        return nullptr;
+    }
+
+    static const char *skipWs(const char *p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+        return p;
+    }
+
+    // p points at an opening quote; returns one past the closing quote.
+    static const char *skipString(const char *p, const char *end, bool &escaped) {
+        for (++p; p < end; ++p) {
+            if (*p == '\\') { escaped = true; ++p; }
+            else if (*p == '"') return p + 1;
+        }
+        return nullptr;
+    }
+
+    // JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    static bool isNumber(std::string_view token) {
+        const char *p = token.data();
+        const char *end = p + token.size();
+        auto digits = [&] {
+            const char *start = p;
+            while (p < end && *p >= '0' && *p <= '9') ++p;
+            return p > start;
+        };
+        if (p < end && *p == '-') ++p;
+        if (p < end && *p == '0') ++p;
+        else if (!digits()) return false;
+        if (p < end && *p == '.') {
+            ++p;
+            if (!digits()) return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            if (p < end && (*p == '+' || *p == '-')) ++p;
+            if (!digits()) return false;
+        }
+        return p == end;
+    }
+
+    static const char *skipNested(const char *p, const char *end) {
+        int depth = 0;
+        while (p < end) {
+            char c = *p;
+            if (c == '"') {
+                bool escaped = false;
+                p = skipString(p, end, escaped);
+                if (!p) return nullptr;
+                continue;
+            }
+            if (c == '[' || c == '{') depth++;
+            else if ((c == ']' || c == '}') && --depth == 0) return p + 1;
+            ++p;
+        }
+        return nullptr;
+    }
+
+    bool scan(std::string_view text) {
+        const char *p = text.data();
+        const char *end = p + text.size();
+        p = skipWs(p, end);
+        if (p == end || *p != '{') return false;
+        p = skipWs(p + 1, end);
+        if (p < end && *p == '}') return true;
+
+        while (p < end) {
+            if (*p != '"') return false;
+            bool keyEscaped = false;
+            const char *keyEnd = skipString(p, end, keyEscaped);
+            if (!keyEnd) return false;
+            std::string_view key(p + 1, keyEnd - p - 2);
+
+            p = skipWs(keyEnd, end);
+            if (p == end || *p != ':') return false;
+            p = skipWs(p + 1, end);
+            if (p == end) return false;
+
+            const char *valueStart = p;
+            bool escaped = false;
+            char kind;
+            if (*p == '"') {
+                kind = '"';
+                p = skipString(p, end, escaped);
+            } else if (*p == '[' || *p == '{') {
+                kind = *p;
+                p = skipNested(p, end);
+            } else {
+                kind = (*p == 't' || *p == 'f') ? 't' : (*p == 'n' ? 'n' : '0');
+                while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+                std::string_view token(valueStart, p - valueStart);
+                bool valid = kind == '0' ? isNumber(token)
+                           : kind == 't' ? (token == "true" || token == "false")
+                           : token == "null";
+                if (!valid) return false;
+            }
+            if (!p) return false;
+
+            if (count_ < MAX_MEMBERS) {
+                members_[count_++] = {key, std::string_view(valueStart, p - valueStart), kind, escaped};
+            }
+
+            p = skipWs(p, end);
+            if (p == end) return false;
+            if (*p == '}') return true;
+            if (*p != ',') return false;
+            p = skipWs(p + 1, end);
+        }
+        return false;
+    }
+
+    Member members_[MAX_MEMBERS];
+    size_t count_ = 0;
+    bool ok_ = false;
+};
+
+// FNV-1a, usable in case labels so command dispatch is a single switch.
+static constexpr uint32_t hashCommand(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
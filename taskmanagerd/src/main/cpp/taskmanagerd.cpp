@@ -5,32 +5,67 @@
 #include <cstring>
 #include <ctime>
 #include <fcntl.h>
+#include <poll.h>
 #include <climits>
 #include <pwd.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <array>
 #include <chrono>
 #include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <memory>
-#include <regex>
-#include <sstream>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <dirent.h>
 
 #include "json.hpp"
+#include "json_writer.h"
+#include "procfs.h"
+#include "request.h"
+#include "wire.h"
+#include "worker_pool.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
+// Hot procfs files that every ping or sample re-reads, each opened once.
+// /proc/stat is only sampled from the CpuSampler thread, the others only from
+// the event loop, so no source is ever shared between threads.
+enum MetricFile {
+    METRIC_FILE_STAT,
+    METRIC_FILE_MEMINFO,
+    METRIC_FILE_NET_DEV,
+    METRIC_FILE_ZRAM_MM_STAT,
+    METRIC_FILE_COUNT,
+};
+
+static MetricSource &metricFile(MetricFile file) {
+    static MetricSource files[METRIC_FILE_COUNT] = {
+            MetricSource("/proc/stat"),
+            MetricSource("/proc/meminfo"),
+            MetricSource("/proc/net/dev"),
+            MetricSource("/sys/block/zram0/mm_stat"),
+    };
+    return files[file];
+}
+
 static std::string toLower(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(),
                    [](unsigned char c){ return std::tolower(c); });
@@ -45,94 +80,134 @@ static bool isCpuThermalType(const std::string& type) {
            (t.find("cluster") != std::string::npos);
 }
 
-int getCpuTemperatureCelsius() {
-    const std::string basePath = "/sys/class/thermal/";
-    DIR* dir = opendir(basePath.c_str());
-    if (!dir) return -1;
+static bool containsAny(const std::string &s, std::initializer_list<const char *> needles) {
+    for (const char *needle : needles) {
+        if (s.find(needle) != std::string::npos) return true;
+    }
+    return false;
+}
 
-    struct dirent* entry;
-    int maxTemp = -1;
+enum ThermalKind {
+    THERMAL_OTHER,
+    THERMAL_CPU,
+    THERMAL_GPU,
+    THERMAL_BATTERY,
+    THERMAL_SKIN,
+};
 
-    while ((entry = readdir(dir)) != nullptr) {
-        std::string name = entry->d_name;
-        if (name.find("thermal_zone") == std::string::npos) continue;
+static const char *thermalKindName(ThermalKind kind) {
+    switch (kind) {
+        case THERMAL_CPU: return "cpu";
+        case THERMAL_GPU: return "gpu";
+        case THERMAL_BATTERY: return "battery";
+        case THERMAL_SKIN: return "skin";
+        default: return "other";
+    }
+}
 
-        std::string zonePath = basePath + name;
-        std::ifstream typeFile(zonePath + "/type");
-        if (!typeFile.is_open()) continue;
+// CPU first so CTEMP_PING keeps covering exactly the zones it always has.
+static ThermalKind classifyThermalType(const std::string &type) {
+    if (isCpuThermalType(type)) return THERMAL_CPU;
+    std::string t = toLower(type);
+    if (containsAny(t, {"gpu", "kgsl", "mali", "g3d"})) return THERMAL_GPU;
+    if (containsAny(t, {"battery", "batt", "bms"})) return THERMAL_BATTERY;
+    if (containsAny(t, {"skin", "shell", "quiet", "xo_therm", "xo-therm", "back_temp"})) return THERMAL_SKIN;
+    return THERMAL_OTHER;
+}
 
-        std::string type;
-        std::getline(typeFile, type);
-        typeFile.close();
+struct ThermalZone {
+    int index;
+    std::string type;
+    ThermalKind kind;
+    MetricSource temp;
+};
 
-        if (!isCpuThermalType(type)) continue;
+// Thermal zones do not appear or change type at runtime, so they are listed
+// and classified on first use and their temp files stay open.
+static std::vector<ThermalZone> &thermalZones() {
+    static std::vector<ThermalZone> zones;
+    static bool discovered = false;
+    if (discovered) return zones;
+    discovered = true;
 
-        std::ifstream tempFile(zonePath + "/temp");
-        if (!tempFile.is_open()) continue;
+    DIR* dir = opendir("/sys/class/thermal");
+    if (!dir) return zones;
 
-        long raw = 0;
-        tempFile >> raw;
-        tempFile.close();
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        int index;
+        char tail;
+        if (sscanf(entry->d_name, "thermal_zone%d%c", &index, &tail) != 1) continue;
+
+        char file[NAME_MAX + 8];
+        std::string_view text;
+        snprintf(file, sizeof(file), "%s/type", entry->d_name);
+        if (!readSmallFile(dirfd(dir), file, text)) continue;
+
+        std::string type(firstLine(text));
+        ThermalKind kind = classifyThermalType(type);
+        std::string tempPath = std::string("/sys/class/thermal/") + entry->d_name + "/temp";
+        zones.push_back({index, std::move(type), kind, MetricSource(std::move(tempPath))});
+    }
+    closedir(dir);
 
-        if (raw <= 0) continue;
+    std::sort(zones.begin(), zones.end(), [](const ThermalZone &a, const ThermalZone &b) { return a.index < b.index; });
+    return zones;
+}
 
-        int tempC = (raw > 1000) ? static_cast<int>(raw / 1000) : static_cast<int>(raw);
-        if (tempC >= 5 && tempC <= 100) {
-            maxTemp = std::max(maxTemp, tempC);
-        }
-    }
+// Zone temperature in degrees Celsius. Most drivers report millidegrees,
+// a few whole degrees.
+static bool readThermalZone(ThermalZone &zone, double &tempC) {
+    std::string_view text;
+    if (!zone.temp.sample(text)) return false;
+    long long raw = parseLeadingInt(text, LLONG_MIN);
+    if (raw == LLONG_MIN) return false;
+    tempC = (raw > 1000 || raw < -1000) ? raw / 1000.0 : (double)raw;
+    return true;
+}
 
-    closedir(dir);
+int getCpuTemperatureCelsius() {
+    int maxTemp = -1;
+    for (ThermalZone &zone : thermalZones()) {
+        if (zone.kind != THERMAL_CPU) continue;
+        double tempC;
+        if (!readThermalZone(zone, tempC) || tempC <= 0) continue;
+        if (tempC >= 5 && tempC <= 100) maxTemp = std::max(maxTemp, (int)tempC);
+    }
     return maxTemp;
 }
 
 std::optional<int> getBatteryCycleCount() {
-    static const std::vector<std::string> paths = {
+    static const char *const paths[] = {
             "/sys/class/power_supply/battery/cycle_count",
             "/sys/class/power_supply/bms/cycle_count",
             "/sys/class/power_supply/Battery/cycle_count",
     };
 
-    for (const auto& path : paths) {
-        std::ifstream file(path);
-        if (!file.is_open()) continue;
-
-        std::string content;
-        std::getline(file, content);
+    // The path that answered last time is kept open and tried first.
+    static MetricSource cycleCount;
+    std::string_view text;
+    if (cycleCount.sample(text)) {
+        long long cycles = parseLeadingInt(text, LLONG_MIN);
+        if (cycles != LLONG_MIN) return (int)cycles;
+    }
 
-        try {
-            return std::stoi(content);
-        } catch (...) {
-            continue;
-        }
+    for (const char *path : paths) {
+        MetricSource source(path);
+        if (!source.sample(text)) continue;
+        long long cycles = parseLeadingInt(text, LLONG_MIN);
+        if (cycles == LLONG_MIN) continue;
+        cycleCount = std::move(source);
+        return (int)cycles;
     }
+    cycleCount = MetricSource();
 
     return std::nullopt;
 }
 
-static std::regex pid_regex("\\d+");
-
-std::vector<int> listPids() {
-    std::vector<int> pids;
-    pids.reserve(256);
-    for (const auto &entry : fs::directory_iterator("/proc")) {
-        try {
-            if (entry.is_directory()) {
-                std::string name = entry.path().filename();
-                if (std::regex_match(name, pid_regex)) {
-                    pids.push_back(std::stoi(name));
-                }
-            }
-        } catch (...) {}
-    }
-    return pids;
-}
-
-static volatile sig_atomic_t keep_running = 1;
-
-void handle_sigint(int) {
-    keep_running = 0;
-}
+// Cleared by STOP_SELF, stdin EOF, or SIGINT/SIGTERM arriving on the signalfd
+// (which also carries SIGCHLD for force-stop children).
+static bool keep_running = true;
 
 std::string now_str() {
     time_t t = time(nullptr);
@@ -148,81 +223,357 @@ void log_line(const std::string &line) {
     write(STDERR_FILENO, msg.c_str(), msg.size());
 }
 
-bool send_msg(const std::string &msg) {
-    std::string data = msg + "\n";
-    size_t total = 0;
-    while (total < data.size()) {
-        ssize_t written = write(STDOUT_FILENO, data.data() + total, data.size() - total);
-        if (written <= 0) return false;
-        total += written;
+// The main loop's epoll set. Each registration's data.u64 carries a tag in
+// the high half and, for pidfds, the watched pid in the low half.
+static int epollFd = -1;
+
+enum EventTag : uint32_t {
+    EVENT_STDIN = 1,
+    EVENT_PIDFD = 2,
+    EVENT_STDOUT = 3,
+    EVENT_SIGNAL = 4,
+    EVENT_SUBSCRIPTION_TIMER = 5,
+};
+
+static uint64_t eventData(EventTag tag, uint32_t value = 0) {
+    return ((uint64_t)tag << 32) | value;
+}
+
+// stdout is non-blocking. Whatever the pipe does not take right away waits
+// here and is flushed on EPOLLOUT, so a slow reader never blocks the loop.
+// Pushed samples are dropped once the backlog passes the limit; replies to
+// requests are always kept.
+struct OutputQueue {
+    static constexpr size_t DROP_SAMPLES_ABOVE = 256 * 1024;
+    static constexpr std::chrono::milliseconds FINAL_FLUSH_TIMEOUT{500};
+
+    std::string pending;
+    size_t offset = 0;
+    bool waitingForPipe = false;
+    bool broken = false;
+    uint64_t droppedSamples = 0;
+
+    size_t size() const { return pending.size() - offset; }
+};
+
+static OutputQueue outputQueue;
+
+static void watchStdoutWritable(bool enable) {
+    if (outputQueue.waitingForPipe == enable || epollFd < 0) return;
+    struct epoll_event ev{};
+    ev.events = EPOLLOUT;
+    ev.data.u64 = eventData(EVENT_STDOUT);
+    epoll_ctl(epollFd, enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, STDOUT_FILENO, &ev);
+    outputQueue.waitingForPipe = enable;
+}
+
+// Writes as much as the pipe takes; false only if the reader is gone.
+static bool writeNonBlocking(const char *&data, size_t &size) {
+    while (size > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written > 0) {
+            data += written;
+            size -= (size_t)written;
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else {
+            return false;
+        }
     }
     return true;
 }
 
+// Called on EPOLLOUT.
+static void flushOutputQueue() {
+    const char *data = outputQueue.pending.data() + outputQueue.offset;
+    size_t size = outputQueue.size();
+    if (!writeNonBlocking(data, size)) outputQueue.broken = true;
+    outputQueue.offset = outputQueue.pending.size() - size;
+    if (outputQueue.size() == 0 || outputQueue.broken) {
+        outputQueue.pending.clear();
+        outputQueue.offset = 0;
+        watchStdoutWritable(false);
+    } else if (outputQueue.offset > outputQueue.pending.size() / 2) {
+        outputQueue.pending.erase(0, outputQueue.offset);
+        outputQueue.offset = 0;
+    }
+}
+
+static bool send_raw(const char *data, size_t size, bool droppable = false) {
+    if (outputQueue.broken) return false;
+    if (outputQueue.size() == 0) {
+        if (!writeNonBlocking(data, size)) {
+            outputQueue.broken = true;
+            return false;
+        }
+        if (size == 0) return true;
+    } else if (droppable && outputQueue.size() > OutputQueue::DROP_SAMPLES_ABOVE) {
+        outputQueue.droppedSamples++;
+        return true;
+    }
+    outputQueue.pending.append(data, size);
+    watchStdoutWritable(true);
+    return true;
+}
+
+// JsonWriter sink.
+static bool send_chunk(const char *data, size_t size) {
+    return send_raw(data, size);
+}
+
+bool send_msg(const std::string &msg, bool droppable = false) {
+    std::string data = msg + "\n";
+    return send_raw(data.data(), data.size(), droppable);
+}
+
+// Output format negotiated with HELLO; newline-delimited JSON until then.
+static WireProtocol wireProtocol = WIRE_JSON;
+static FrameWriter frameWriter;
+
+bool send_frame(FrameWriter &frame, bool droppable = false) {
+    const std::string &data = frame.finish();
+    return send_raw(data.data(), data.size(), droppable);
+}
+
 bool send_json(const json &j) {
+    if (wireProtocol == WIRE_BINARY) {
+        frameWriter.begin(FRAME_JSON);
+        frameWriter.putBytes(j.dump());
+        return send_frame(frameWriter);
+    }
     return send_msg(j.dump());
 }
 
-struct CpuStat {
-    long user, nice, system, idle, iowait, irq, softirq, steal;
-    long total() const { return user + nice + system + idle + iowait + irq + softirq + steal; }
-    long active() const { return total() - idle; }
+static constexpr int MAX_CPUS = 64;
+
+// One /proc/stat snapshot as parallel arrays. Slot 0 is the aggregate "cpu"
+// line and slot N + 1 is "cpuN"; offline cores have no line and stay absent.
+struct CpuStatTable {
+    int slots;
+    bool present[MAX_CPUS + 1];
+    long long total[MAX_CPUS + 1];
+    long long idle[MAX_CPUS + 1];
 };
 
-CpuStat readCpuStat() {
-    std::ifstream file("/proc/stat");
-    if (!file.is_open()) return {0,0,0,0,0,0,0,0};
-    std::string line;
-    std::getline(file, line);
-    if (line.rfind("cpu ", 0) == 0) {
-        std::istringstream iss(line);
-        std::string cpuLabel;
-        long v[8] = {0};
-        iss >> cpuLabel;
-        for (int i = 0; i < 8; ++i) if (!(iss >> v[i])) break;
-        return {v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]};
+// Reads every cpu line of /proc/stat in a single pread(). The cpu lines always
+// come first, so a truncated tail (the long "intr" line) does not matter.
+bool readCpuStat(CpuStatTable &table) {
+    table.slots = 0;
+    std::fill(std::begin(table.present), std::end(table.present), false);
+
+    std::string_view text;
+    if (!metricFile(METRIC_FILE_STAT).sample(text) || text.empty()) return false;
+
+    const char *p = text.data();
+    const char *end = p + text.size();
+    while (end - p > 3 && p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+        p += 3;
+        unsigned long long slot = 0;
+        if (*p >= '0' && *p <= '9') {
+            p = parseUnsigned(p, end, slot);
+            slot += 1;
+        }
+
+        unsigned long long v[8];
+        unsigned long long sum = 0;
+        for (auto &field : v) {
+            p = parseUnsigned(skipSpaces(p, end), end, field);
+            sum += field;
+        }
+
+        if (slot <= MAX_CPUS) {
+            table.present[slot] = true;
+            table.total[slot] = (long long)sum;
+            table.idle[slot] = (long long)v[3];
+            table.slots = std::max(table.slots, (int)slot + 1);
+        }
+
+        p = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!p) break;
+        ++p;
     }
-    return {0,0,0,0,0,0,0,0};
+    return table.present[0];
 }
 
-int calculateCpuUsage() {
-    CpuStat prev = readCpuStat();
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    CpuStat curr = readCpuStat();
-    uint64_t totalDiff = curr.total() - prev.total();
-    uint64_t activeDiff = curr.active() - prev.active();
-    if (totalDiff == 0) return 0;
+// Usage of one slot between two snapshots, or -1 if the core was offline in
+// either of them.
+static int cpuUsageBetween(const CpuStatTable &prev, const CpuStatTable &curr, int slot) {
+    if (!prev.present[slot] || !curr.present[slot]) return -1;
+    long long totalDiff = curr.total[slot] - prev.total[slot];
+    long long activeDiff = totalDiff - (curr.idle[slot] - prev.idle[slot]);
+    if (totalDiff <= 0) return 0;
     double usage = (double)activeDiff / (double)totalDiff * 100.0;
     return std::clamp((int)usage, 0, 100);
 }
 
+// Samples /proc/stat on a background thread and keeps the most recent deltas
+// in a ring, so CPU_PING can answer without sleeping on the command thread.
+class CpuSampler {
+public:
+    static constexpr size_t RING_SIZE = 64;
+    static constexpr int DEFAULT_INTERVAL_MS = 100;
+    static constexpr int MIN_INTERVAL_MS = 10;
+    static constexpr int MAX_INTERVAL_MS = 10000;
+
+    struct Sample {
+        int usage;
+        int cores;
+        std::array<int8_t, MAX_CPUS> coreUsage;
+        std::chrono::steady_clock::time_point timestamp;
+    };
+
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) return;
+        running_ = true;
+        thread_ = std::thread(&CpuSampler::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) return;
+            running_ = false;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    int setIntervalMs(int ms) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            intervalMs_ = std::clamp(ms, MIN_INTERVAL_MS, MAX_INTERVAL_MS);
+        }
+        cv_.notify_all();
+        return intervalMs();
+    }
+
+    int intervalMs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return intervalMs_;
+    }
+
+    // Returns the newest sample. Right after startup the ring is still empty,
+    // so wait (at most one interval) for the first delta to land.
+    Sample latest() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (count_ == 0) {
+            cv_.wait_for(lock, std::chrono::milliseconds(intervalMs_ * 2),
+                         [this] { return count_ > 0 || !running_; });
+            if (count_ == 0) return {0, 0, {}, std::chrono::steady_clock::now()};
+        }
+        return ring_[(head_ + RING_SIZE - 1) % RING_SIZE];
+    }
+
+private:
+    // SIGINT/SIGTERM are blocked before this thread starts and inherited as
+    // such; main() takes them from a signalfd.
+    void run() {
+        CpuStatTable prev{};
+        CpuStatTable curr{};
+        readCpuStat(prev);
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            cv_.wait_for(lock, std::chrono::milliseconds(intervalMs_));
+            if (!running_) break;
+
+            lock.unlock();
+            readCpuStat(curr);
+            Sample sample{};
+            sample.usage = std::max(cpuUsageBetween(prev, curr, 0), 0);
+            sample.cores = std::max(0, std::min(curr.slots - 1, MAX_CPUS));
+            for (int core = 0; core < sample.cores; ++core) {
+                sample.coreUsage[core] = (int8_t)cpuUsageBetween(prev, curr, core + 1);
+            }
+            sample.timestamp = std::chrono::steady_clock::now();
+            std::swap(prev, curr);
+            lock.lock();
+
+            ring_[head_] = sample;
+            head_ = (head_ + 1) % RING_SIZE;
+            if (count_ < RING_SIZE) count_++;
+            cv_.notify_all();
+        }
+    }
+
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+    std::thread thread_;
+    std::array<Sample, RING_SIZE> ring_{};
+    size_t head_ = 0;
+    size_t count_ = 0;
+    int intervalMs_ = DEFAULT_INTERVAL_MS;
+    bool running_ = false;
+};
+
+static CpuSampler cpuSampler;
+
+int calculateCpuUsage() {
+    return cpuSampler.latest().usage;
+}
+
 // Parses files that expose GPU busy time. Supports several formats:
 //   - single percentage value ("50")
 //   - busy/total pairs separated by whitespace, '@' or '/' ("1234 5678", "1234@5678")
-// Returns usage 0..100, or -1 when the file is unreadable/unsupported.
-static int readBusyPercentageFile(const std::string& path) {
-    std::ifstream file(path);
-    std::string line;
-    if (!std::getline(file, line)) return -1;
-
-    for (char& c : line) {
-        if (!std::isdigit(static_cast<unsigned char>(c))) c = ' ';
+// Returns usage 0..100, or -1 when the contents are unsupported.
+static int parseBusyPercentage(std::string_view text) {
+    std::string_view line = firstLine(text);
+
+    // Any non-digit separates numbers, so signs and units are ignored.
+    const char *p = line.data();
+    const char *end = p + line.size();
+    unsigned long long values[2];
+    int count = 0;
+    while (count < 2) {
+        while (p < end && (*p < '0' || *p > '9')) ++p;
+        if (p == end) break;
+        p = parseUnsigned(p, end, values[count++]);
     }
 
-    std::istringstream iss(line);
-    long a = -1, b = -1;
-    if (!(iss >> a)) return -1;
-    if (iss >> b) {
-        if (b > 0) return std::clamp((int)(a * 100 / b), 0, 100);
-    } else if (a >= 0 && a <= 100) {
-        return (int)a;
+    if (count == 2) {
+        if (values[1] > 0) return std::clamp((int)(values[0] * 100 / values[1]), 0, 100);
+        // An idle KGSL gpubusy window reads "0 0".
+        if (values[0] == 0) return 0;
+    } else if (count == 1 && values[0] <= 100) {
+        return (int)values[0];
     }
     return -1;
 }
 
+// The GPU busy file that answered the last probe, kept open so GPU_PING is
+// one pread. Only a failed read closes it and makes the next call probe
+// again; contents that do not parse just lose that sample. When no source
+// exists at all the probe is retried at most once per interval.
+struct GpuSource {
+    static constexpr auto REPROBE_INTERVAL = std::chrono::seconds(30);
+
+    int fd = -1;
+    bool probed = false;
+    std::chrono::steady_clock::time_point probedAt;
+};
+
+static GpuSource gpuSource;
+
+// Opens path and keeps it as the GPU source if it parses. Returns the usage,
+// or -1 when the file is missing or unsupported.
+static int tryGpuSource(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    std::string_view text;
+    int usage = preadSmallFile(fd, text) ? parseBusyPercentage(text) : -1;
+    if (usage < 0) {
+        close(fd);
+        return -1;
+    }
+    gpuSource.fd = fd;
+    return usage;
+}
+
 // Scans /sys/class/devfreq for a GPU-related node exposing a "load" file.
 // Works on many SoCs (Exynos, MediaTek, Kirin, etc.).
-static int readDevfreqGpuLoad() {
+static int probeDevfreqGpuLoad() {
     const fs::path base("/sys/class/devfreq");
     std::error_code ec;
     if (!fs::is_directory(base, ec)) return -1;
@@ -237,46 +588,52 @@ static int readDevfreqGpuLoad() {
             name.find("panfrost") == std::string::npos) {
             continue;
         }
-        int load = readBusyPercentageFile((entry.path() / "load").string());
+        int load = tryGpuSource((entry.path() / "load").c_str());
         if (load >= 0) return load;
     }
     return -1;
 }
 
-int calculateGpuUsage() {
-    // Qualcomm Adreno (KGSL)
-    int usage = readBusyPercentageFile("/sys/class/kgsl/kgsl-3d0/gpu_busy_percentage");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/sys/class/kgsl/kgsl-3d0/gpubusy");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/sys/class/kgsl/kgsl-3d0/gpu_busy");
-    if (usage >= 0) return usage;
-
-    // ARM Mali
-    usage = readBusyPercentageFile("/sys/class/misc/mali0/device/utilization");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/sys/class/misc/mali0/device/gpu_busy_percentage");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/proc/mali/utilization");
-    if (usage >= 0) return usage;
-
-    // Samsung Exynos / generic
-    usage = readBusyPercentageFile("/sys/kernel/gpu/gpu_busy");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/sys/kernel/gpu/gpu_busy_percentage");
-    if (usage >= 0) return usage;
-
-    // Root-only debugfs paths
-    usage = readBusyPercentageFile("/sys/kernel/debug/kgsl/kgsl-3d0/gpubusy");
-    if (usage >= 0) return usage;
-    usage = readBusyPercentageFile("/d/kgsl/kgsl-3d0/gpubusy");
-    if (usage >= 0) return usage;
+static int probeGpuSource() {
+    static const char *const paths[] = {
+            // Qualcomm Adreno (KGSL)
+            "/sys/class/kgsl/kgsl-3d0/gpu_busy_percentage",
+            "/sys/class/kgsl/kgsl-3d0/gpubusy",
+            "/sys/class/kgsl/kgsl-3d0/gpu_busy",
+            // ARM Mali
+            "/sys/class/misc/mali0/device/utilization",
+            "/sys/class/misc/mali0/device/gpu_busy_percentage",
+            "/proc/mali/utilization",
+            // Samsung Exynos / generic
+            "/sys/kernel/gpu/gpu_busy",
+            "/sys/kernel/gpu/gpu_busy_percentage",
+            // Root-only debugfs paths
+            "/sys/kernel/debug/kgsl/kgsl-3d0/gpubusy",
+            "/d/kgsl/kgsl-3d0/gpubusy",
+    };
 
+    gpuSource.probed = true;
+    gpuSource.probedAt = std::chrono::steady_clock::now();
+    for (const char *path : paths) {
+        int usage = tryGpuSource(path);
+        if (usage >= 0) return usage;
+    }
     // Generic devfreq load
-    usage = readDevfreqGpuLoad();
-    if (usage >= 0) return usage;
+    return probeDevfreqGpuLoad();
+}
 
-    return -1;
+int calculateGpuUsage() {
+    if (gpuSource.fd >= 0) {
+        std::string_view text;
+        if (preadSmallFile(gpuSource.fd, text)) return parseBusyPercentage(text);
+        close(gpuSource.fd);
+        gpuSource.fd = -1;
+        gpuSource.probed = false;
+    }
+    if (gpuSource.probed && std::chrono::steady_clock::now() - gpuSource.probedAt < GpuSource::REPROBE_INTERVAL) {
+        return -1;
+    }
+    return probeGpuSource();
 }
 
 bool killProcess(int pid) {
@@ -289,6 +646,190 @@ bool killProcessGroup(pid_t pgid, int signal = SIGKILL) {
     return kill(-pgid, signal) == 0;
 }
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+static int pidfdOpen(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+// Cleared the first time the kernel reports ENOSYS (pre-5.3), after which
+// signals go through plain kill().
+static bool pidfdSupported = true;
+
+// Forward declaration; defined with the /proc/<pid>/stat parser below.
+static bool readProcStartTime(int pid, long &startTime);
+
+// Sends sig to pid and returns 0 or an errno value. With pidfds the process
+// is pinned before it is checked, so when expectedStartTime is given a PID
+// that was recycled since the client saw it is refused with ESRCH instead of
+// signalling the new owner.
+int signalProcess(pid_t pid, int sig, long expectedStartTime = -1) {
+    if (pid <= 0) return EINVAL;
+
+    int pidfd = -1;
+    if (pidfdSupported) {
+        pidfd = pidfdOpen(pid);
+        if (pidfd < 0 && errno == ENOSYS) pidfdSupported = false;
+        else if (pidfd < 0) return errno;
+    }
+
+    int err = 0;
+    long startTime = 0;
+    if (expectedStartTime >= 0 && (!readProcStartTime(pid, startTime) || startTime != expectedStartTime)) {
+        err = ESRCH;
+    } else if (pidfd >= 0) {
+        if (syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0) != 0) err = errno;
+    } else if (kill(pid, sig) != 0) {
+        err = errno;
+    }
+
+    if (pidfd >= 0) close(pidfd);
+    return err;
+}
+
+// Android package names: [A-Za-z0-9._], at most 255 characters. Checked by
+// hand since the name goes straight into an argv.
+static bool isValidPackageName(std::string_view pkg) {
+    if (pkg.empty() || pkg.size() > 255) return false;
+    for (char c : pkg) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (c >= '0' && c <= '9') || c == '.' || c == '_';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Runs `am force-stop <pkg>` via fork/exec without a shell. The child's
+// stdin/stdout go to /dev/null so nothing it prints can land in the pipe the
+// app is reading replies from. Returns the child's pid, or -1.
+static pid_t spawnForceStop(const std::string &pkg) {
+    const char *argv[] = {"am", "force-stop", pkg.c_str(), nullptr};
+    pid_t child = fork();
+    if (child != 0) return child;
+
+    // Undo what the daemon set up for itself before handing over to am.
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, nullptr);
+    signal(SIGPIPE, SIG_DFL);
+
+    int devnull = open("/dev/null", O_RDWR);
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+    }
+    execvp(argv[0], const_cast<char *const *>(argv));
+    _exit(127);
+}
+
+// Each am invocation starts a JVM, so a batch runs a few of them at a time
+// instead of one after another; more would just fight over memory.
+static constexpr size_t MAX_PARALLEL_FORCE_STOPS = 4;
+
+// One FORCE_STOP or FORCE_STOP_MANY request. Its am children are reaped from
+// the event loop on SIGCHLD, and the reply goes out once the last one exits,
+// so a long batch never stalls the event loop.
+struct ForceStopBatch {
+    bool many;
+    std::vector<std::string> pkgs;
+    std::vector<bool> results;
+    size_t next = 0;
+    size_t running = 0;
+
+    bool done() const { return next == pkgs.size() && running == 0; }
+};
+
+struct ForceStopChild {
+    pid_t pid;
+    std::shared_ptr<ForceStopBatch> batch;
+    size_t index;
+};
+
+// Batches in arrival order; replies are sent in the same order.
+static std::deque<std::shared_ptr<ForceStopBatch>> forceStopBatches;
+static std::vector<ForceStopChild> forceStopChildren;
+
+static void sendForceStopResult(const ForceStopBatch &batch) {
+    json j_out;
+    if (!batch.many) {
+        j_out["type"] = "KILL_RESULT";
+        j_out["success"] = static_cast<bool>(batch.results[0]);
+        send_json(j_out);
+        return;
+    }
+    json results_j = json::object();
+    bool allStopped = !batch.pkgs.empty();
+    for (size_t i = 0; i < batch.pkgs.size(); ++i) {
+        results_j[batch.pkgs[i]] = static_cast<bool>(batch.results[i]);
+        allStopped = allStopped && batch.results[i];
+    }
+    j_out["type"] = "FORCE_STOP_RESULT";
+    j_out["success"] = allStopped;
+    j_out["results"] = results_j;
+    send_json(j_out);
+}
+
+// Spawns queued packages up to the parallel limit, then replies for every
+// finished batch at the front of the queue.
+static void runForceStops() {
+    for (auto &batch : forceStopBatches) {
+        while (batch->next < batch->pkgs.size() && forceStopChildren.size() < MAX_PARALLEL_FORCE_STOPS) {
+            size_t index = batch->next++;
+            if (!isValidPackageName(batch->pkgs[index])) continue;
+            pid_t child = spawnForceStop(batch->pkgs[index]);
+            if (child <= 0) continue;
+            forceStopChildren.push_back({child, batch, index});
+            batch->running++;
+        }
+    }
+    while (!forceStopBatches.empty() && forceStopBatches.front()->done()) {
+        sendForceStopResult(*forceStopBatches.front());
+        forceStopBatches.pop_front();
+    }
+}
+
+void forceStopPackages(std::vector<std::string> pkgs, bool many) {
+    auto batch = std::make_shared<ForceStopBatch>();
+    batch->many = many;
+    batch->results.assign(pkgs.size(), false);
+    batch->pkgs = std::move(pkgs);
+    forceStopBatches.push_back(std::move(batch));
+    runForceStops();
+}
+
+// True while a single FORCE_STOP is waiting for its reply.
+static bool forceStopHoldsCommands() {
+    return std::any_of(forceStopBatches.begin(), forceStopBatches.end(),
+                       [](const std::shared_ptr<ForceStopBatch> &batch) { return !batch->many; });
+}
+
+// Called when SIGCHLD arrives on the signalfd. Signals coalesce, so every
+// outstanding child is polled.
+static void reapForceStops() {
+    for (size_t i = 0; i < forceStopChildren.size();) {
+        ForceStopChild &child = forceStopChildren[i];
+        int status = 0;
+        pid_t r;
+        do {
+            r = waitpid(child.pid, &status, WNOHANG);
+        } while (r < 0 && errno == EINTR);
+        if (r == 0) {
+            ++i;
+            continue;
+        }
+        child.batch->results[child.index] = r == child.pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        child.batch->running--;
+        forceStopChildren[i] = std::move(forceStopChildren.back());
+        forceStopChildren.pop_back();
+    }
+    runForceStops();
+}
+
 struct Proc {
     int pid;
     std::string name;
@@ -309,135 +850,860 @@ struct Proc {
     std::string executablePath;
 };
 
+// Bits for the keys LIST_PROCESS can be asked to return. readProc only opens
+// the /proc files that the requested fields need.
+enum ProcField : uint32_t {
+    FIELD_PID = 1u << 0,
+    FIELD_NAME = 1u << 1,
+    FIELD_NICE = 1u << 2,
+    FIELD_UID = 1u << 3,
+    FIELD_CPU_USAGE = 1u << 4,
+    FIELD_PARENT_PID = 1u << 5,
+    FIELD_IS_FOREGROUND = 1u << 6,
+    FIELD_MEMORY_USAGE = 1u << 7,
+    FIELD_CMDLINE = 1u << 8,
+    FIELD_STATE = 1u << 9,
+    FIELD_THREADS = 1u << 10,
+    FIELD_START_TIME = 1u << 11,
+    FIELD_ELAPSED_TIME = 1u << 12,
+    FIELD_RSS = 1u << 13,
+    FIELD_VSIZE = 1u << 14,
+    FIELD_CGROUP = 1u << 15,
+    FIELD_EXECUTABLE_PATH = 1u << 16,
+    FIELD_ALL = (1u << 17) - 1,
+};
+
+// cgroup is not among them: Android moves an app between top-app, foreground
+// and background at runtime, so it is re-read on every scan.
+static constexpr uint32_t FIELDS_FROM_STATIC = FIELD_NAME | FIELD_CMDLINE | FIELD_EXECUTABLE_PATH;
+
+static const struct {
+    const char *key;
+    ProcField field;
+} procFieldKeys[] = {
+    {"pid", FIELD_PID}, {"name", FIELD_NAME}, {"nice", FIELD_NICE}, {"uid", FIELD_UID},
+    {"cpuUsage", FIELD_CPU_USAGE}, {"parentPid", FIELD_PARENT_PID}, {"isForeground", FIELD_IS_FOREGROUND},
+    {"memoryUsageKb", FIELD_MEMORY_USAGE}, {"cmdLine", FIELD_CMDLINE}, {"state", FIELD_STATE},
+    {"threads", FIELD_THREADS}, {"startTime", FIELD_START_TIME}, {"elapsedTime", FIELD_ELAPSED_TIME},
+    {"residentSetSizeKb", FIELD_RSS}, {"virtualMemoryKb", FIELD_VSIZE},
+    {"cgroup", FIELD_CGROUP}, {"executablePath", FIELD_EXECUTABLE_PATH},
+};
+
+// Turns a "fields" array from a request into a mask. A missing or empty
+// array means every field; unknown keys are ignored.
+uint32_t parseProcFields(const json &fields) {
+    if (!fields.is_array() || fields.empty()) return FIELD_ALL;
+    uint32_t mask = FIELD_PID;
+    for (const auto &f : fields) {
+        if (!f.is_string()) continue;
+        const auto &key = f.get_ref<const std::string &>();
+        for (const auto &entry : procFieldKeys) {
+            if (key == entry.key) { mask |= entry.field; break; }
+        }
+    }
+    return mask;
+}
+
+// System uptime in clock ticks. /proc/uptime prints seconds with exactly two
+// decimals, so it is parsed as fixed point rather than through a double.
 long getSystemUptime() {
-    std::ifstream uptime("/proc/uptime");
-    double uptimeSeconds = 0.0;
-    if (uptime.is_open()) uptime >> uptimeSeconds;
-    return static_cast<long>(uptimeSeconds * sysconf(_SC_CLK_TCK));
+    static const long clkTck = sysconf(_SC_CLK_TCK);
+    std::string_view text;
+    if (!readSmallFile(AT_FDCWD, "/proc/uptime", text)) return 0;
+    const char *end = text.data() + text.size();
+    unsigned long long seconds = 0, centis = 0;
+    const char *p = parseUnsigned(text.data(), end, seconds);
+    if (p < end && *p == '.') parseUnsigned(p + 1, std::min(p + 3, end), centis);
+    return static_cast<long>(seconds * clkTck + centis * clkTck / 100);
 }
 
-float calculateProcessCpuUsage(int pid) {
-    std::string statPath = "/proc/" + std::to_string(pid) + "/stat";
-    std::ifstream statFile(statPath);
-    if (!statFile.is_open()) return 0.0f;
-    std::string line;
-    std::getline(statFile, line);
-    size_t lastParen = line.rfind(')');
-    if (lastParen == std::string::npos) return 0.0f;
-    std::istringstream iss(line.substr(lastParen + 2));
-    std::string state;
-    long utime = 0, stime = 0, starttime = 0;
-    for (int i = 0; i < 11; ++i) { std::string dummy; iss >> dummy; }
-    iss >> utime >> stime;
-    for (int i = 0; i < 6; ++i) { std::string dummy; iss >> dummy; }
-    iss >> starttime;
-    long totalTime = utime + stime;
-    long uptime = getSystemUptime();
-    long elapsedTime = uptime - starttime;
-    if (elapsedTime > 0) return (100.0f * totalTime) / elapsedTime;
-    return 0.0f;
+// Previous utime+stime per PID, so CPU% covers the time since the last
+// observation rather than the whole lifetime of the process. starttime is kept
+// alongside to detect a PID being reused by a new process.
+struct ProcCpuSnapshot {
+    long startTime;
+    long ticks;
+    float usage;
+    uint32_t generation;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+static std::unordered_map<int, ProcCpuSnapshot> procCpuTable;
+// Bumped once per collectProcs() pass; table entries not stamped with the
+// current value belong to processes that have gone away.
+static uint32_t procScanGeneration = 0;
+
+// Observations closer together than this are too coarse at 100 Hz ticks; the
+// previous value is reported and the baseline is left alone.
+static constexpr double PROC_CPU_MIN_WINDOW_SEC = 0.25;
+
+static float trackProcessCpuUsage(int pid, long startTime, long ticks, long uptime) {
+    static const long clkTck = sysconf(_SC_CLK_TCK);
+    auto now = std::chrono::steady_clock::now();
+
+    auto it = procCpuTable.find(pid);
+    if (it != procCpuTable.end() && it->second.startTime == startTime) {
+        ProcCpuSnapshot &prev = it->second;
+        prev.generation = procScanGeneration;
+        double elapsed = std::chrono::duration<double>(now - prev.timestamp).count();
+        if (elapsed < PROC_CPU_MIN_WINDOW_SEC) return prev.usage;
+
+        long diff = std::max(ticks - prev.ticks, 0L);
+        prev.usage = static_cast<float>(100.0 * diff / clkTck / elapsed);
+        prev.ticks = ticks;
+        prev.timestamp = now;
+        return prev.usage;
+    }
+
+    // First sighting (or a reused PID): fall back to the lifetime average until
+    // there is an interval to measure.
+    long elapsedTicks = uptime - startTime;
+    float usage = elapsedTicks > 0 ? (100.0f * ticks) / elapsedTicks : 0.0f;
+    procCpuTable[pid] = {startTime, ticks, usage, procScanGeneration, now};
+    return usage;
 }
 
-bool isForegroundProcess(int pid) {
-    std::string oomPath = "/proc/" + std::to_string(pid) + "/oom_score_adj";
-    std::ifstream oomFile(oomPath);
-    if (!oomFile.is_open()) return false;
-    int oomScore = 0;
-    oomFile >> oomScore;
-    return oomScore <= 100;
+// Drops table entries for processes that were not seen in the latest scan.
+static void pruneProcessCpuTable() {
+    for (auto it = procCpuTable.begin(); it != procCpuTable.end();) {
+        if (it->second.generation != procScanGeneration) it = procCpuTable.erase(it);
+        else ++it;
+    }
 }
 
-std::string getCgroup(int pid) {
-    std::string cgroupPath = "/proc/" + std::to_string(pid) + "/cgroup";
-    std::ifstream cgroupFile(cgroupPath);
-    if (!cgroupFile.is_open()) return "";
-    std::string line;
-    if (std::getline(cgroupFile, line)) {
-        size_t colonPos = line.find_last_of(':');
-        if (colonPos != std::string::npos) return line.substr(colonPos + 1);
+// Everything readProc needs from /proc/<pid>/stat.
+struct ProcStatFields {
+    char state;
+    int parentPid;
+    int nice;
+    int threads;
+    long utime;
+    long stime;
+    long startTime;
+    unsigned long long vsizeBytes;
+    long rssPages;
+};
+
+// Tokenizes /proc/<pid>/stat in one pass. comm may contain spaces and
+// parentheses, so fields are counted from the last ')'.
+static bool parseProcStat(const char *buf, size_t len, ProcStatFields &out) {
+    const char *end = buf + len;
+    const char *p = end;
+    while (p > buf && p[-1] != ')') --p;
+    if (p == buf || end - p < 2) return false;
+    ++p;
+
+    out = {};
+    out.state = *p;
+    p += 2;
+    // Field numbers follow proc(5); field 3 (state) was consumed above.
+    for (int field = 4; field <= 24 && p < end; ++field) {
+        long long v = 0;
+        const char *next = parseSigned(p, end, v);
+        switch (field) {
+            case 4:  out.parentPid = (int)v; break;
+            case 14: out.utime = (long)v; break;
+            case 15: out.stime = (long)v; break;
+            case 19: out.nice = (int)v; break;
+            case 20: out.threads = (int)v; break;
+            case 22: out.startTime = (long)v; break;
+            case 23: out.vsizeBytes = (unsigned long long)v; break;
+            case 24: out.rssPages = (long)v; break;
+            default: break;
+        }
+        while (next < end && *next != ' ') ++next;
+        p = next + 1;
     }
-    return line;
+    return true;
+}
+
+// /proc/<pid> directory fds held open for watched processes. The fd stays
+// bound to the process instance it was opened for: once that process exits,
+// reads through it fail rather than landing on a new owner of the PID.
+static std::unordered_map<int, int> procDirCache;
+
+// Directory fd for one process, through which all of its files are opened
+// with openat. Uses the cached fd of a watched PID, otherwise opens one for
+// the lifetime of this object.
+class ProcDir {
+public:
+    explicit ProcDir(int pid) {
+        auto it = procDirCache.find(pid);
+        if (it != procDirCache.end()) {
+            fd_ = it->second;
+        } else {
+            fd_ = openProcDir(pid);
+            owned_ = true;
+        }
+    }
+
+    ~ProcDir() {
+        if (owned_ && fd_ >= 0) close(fd_);
+    }
+
+    ProcDir(const ProcDir &) = delete;
+    ProcDir &operator=(const ProcDir &) = delete;
+
+    int fd() const { return fd_; }
+    explicit operator bool() const { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+    bool owned_ = false;
+};
+
+static bool readProcStat(int procDir, ProcStatFields &out) {
+    std::string_view text;
+    return readSmallFile(procDir, "stat", text) && !text.empty() && parseProcStat(text.data(), text.size(), out);
 }
 
-std::string getExecutablePath(int pid) {
-    std::string exePath = "/proc/" + std::to_string(pid) + "/exe";
+static bool readProcStartTime(int pid, long &startTime) {
+    ProcDir dir(pid);
+    ProcStatFields stat;
+    if (!dir || !readProcStat(dir.fd(), stat)) return false;
+    startTime = stat.startTime;
+    return true;
+}
+
+// Mirrors the strings the kernel prints on the State: line of /proc/<pid>/status.
+static const char *procStateName(char state) {
+    switch (state) {
+        case 'R': return "R (running)";
+        case 'S': return "S (sleeping)";
+        case 'D': return "D (disk sleep)";
+        case 'T': return "T (stopped)";
+        case 't': return "t (tracing stop)";
+        case 'X': return "X (dead)";
+        case 'Z': return "Z (zombie)";
+        case 'P': return "P (parked)";
+        case 'I': return "I (idle)";
+        default:  return "";
+    }
+}
+
+float calculateProcessCpuUsage(int pid) {
+    ProcDir dir(pid);
+    ProcStatFields stat;
+    if (!dir || !readProcStat(dir.fd(), stat)) return 0.0f;
+    return trackProcessCpuUsage(pid, stat.startTime, stat.utime + stat.stime, getSystemUptime());
+}
+
+bool isForegroundProcess(int procDir) {
+    std::string_view text;
+    if (!readSmallFile(procDir, "oom_score_adj", text)) return false;
+    return parseLeadingInt(text, 0) <= 100;
+}
+
+std::string getCgroup(int procDir) {
+    std::string_view text;
+    if (!readSmallFile(procDir, "cgroup", text)) return "";
+    std::string_view line = firstLine(text);
+    size_t colonPos = line.find_last_of(':');
+    if (colonPos != std::string_view::npos) line.remove_prefix(colonPos + 1);
+    return std::string(line);
+}
+
+std::string getExecutablePath(int procDir) {
     char path[PATH_MAX];
-    ssize_t len = readlink(exePath.c_str(), path, sizeof(path) - 1);
+    ssize_t len = readlinkat(procDir, "exe", path, sizeof(path) - 1);
     if (len != -1) { path[len] = '\0'; return std::string(path); }
     return "";
 }
 
-Proc readProc(int pid) {
-    Proc p{}; p.pid = pid;
-    std::string procPath = "/proc/" + std::to_string(pid);
-    std::ifstream commFile(procPath + "/comm");
-    if (commFile.is_open()) std::getline(commFile, p.name);
-    std::ifstream cmdFile(procPath + "/cmdline", std::ios::binary);
-    if (cmdFile.is_open()) std::getline(cmdFile, p.cmdLine, '\0');
-    std::ifstream statFile(procPath + "/stat");
-    if (statFile.is_open()) {
-        std::string line; std::getline(statFile, line);
-        size_t lastParen = line.rfind(')');
-        if (lastParen != std::string::npos) {
-            std::istringstream iss(line.substr(lastParen + 2));
-            std::string dummy;
-            for (int i = 0; i < 6; ++i) iss >> dummy;
-            for (int i = 0; i < 9; ++i) iss >> dummy;
-            iss >> dummy;
-            iss >> p.nice;
-            iss >> dummy >> dummy;
-            iss >> p.startTime;
+// Per-process strings that do not change for the lifetime of a process,
+// keyed by PID and checked against starttime so a reused PID is re-read.
+struct ProcStaticInfo {
+    long startTime;
+    uint32_t generation;
+    uint32_t loaded;
+    std::string name;
+    std::string cmdLine;
+    std::string executablePath;
+};
+
+static std::unordered_map<int, ProcStaticInfo> procStaticCache;
+
+// Freshly forked app processes still carry zygote's name and cmdline until
+// they specialize, so they are only cached once they have settled.
+static constexpr long PROC_STATIC_MIN_AGE_SEC = 5;
+
+static void pruneProcessStaticCache() {
+    for (auto it = procStaticCache.begin(); it != procStaticCache.end();) {
+        if (it->second.generation != procScanGeneration) it = procStaticCache.erase(it);
+        else ++it;
+    }
+}
+
+// Reads whichever of the requested static fields info does not hold yet.
+static void readProcStaticInfo(int procDir, ProcStaticInfo &info, uint32_t fields) {
+    uint32_t missing = fields & FIELDS_FROM_STATIC & ~info.loaded;
+    std::string_view text;
+    if ((missing & FIELD_NAME) && readSmallFile(procDir, "comm", text)) {
+        info.name.assign(firstLine(text));
+    }
+    // Only argv[0]: the arguments follow it NUL-separated.
+    if ((missing & FIELD_CMDLINE) && readSmallFile(procDir, "cmdline", text)) {
+        info.cmdLine.assign(text.substr(0, text.find('\0')));
+    }
+    if (missing & FIELD_EXECUTABLE_PATH) info.executablePath = getExecutablePath(procDir);
+    info.loaded |= missing;
+}
+
+static void applyProcStaticInfo(Proc &p, ProcStaticInfo &&info) {
+    p.name = std::move(info.name);
+    p.cmdLine = std::move(info.cmdLine);
+    p.executablePath = std::move(info.executablePath);
+}
+
+// Copies the static strings a scan read from /proc back into a cache entry.
+static void storeProcStaticInfo(ProcStaticInfo &info, const Proc &p, uint32_t read) {
+    if (read & FIELD_NAME) info.name = p.name;
+    if (read & FIELD_CMDLINE) info.cmdLine = p.cmdLine;
+    if (read & FIELD_EXECUTABLE_PATH) info.executablePath = p.executablePath;
+    info.loaded |= read;
+}
+
+// One slot of a /proc scan. scanProc runs on the worker pool and only reads
+// the per-PID tables; commitProcScan applies the CPU delta and static cache
+// updates afterwards on the calling thread.
+struct ProcScan {
+    Proc proc;
+    long cpuTicks;
+    bool statRead;
+    // Static fields that were read from /proc rather than procStaticCache.
+    uint32_t staticRead;
+};
+
+// /proc/<pid>/stat is always read: it is cheap and its starttime is what the
+// per-PID tables use to detect reuse. status, oom_score_adj, cgroup and the
+// static strings are only read when fields asks for them. Everything goes through
+// one directory fd, so all fields describe the same process instance even if
+// the PID is recycled mid-scan. A process that is already gone leaves the
+// slot with pid 0.
+static void scanProc(int pid, long uptime, uint32_t fields, ProcScan &out) {
+    static const long clkTck = sysconf(_SC_CLK_TCK);
+    static const long pageKb = sysconf(_SC_PAGESIZE) / 1024;
+
+    out = ProcScan{};
+    ProcDir dir(pid);
+    if (!dir) return;
+    Proc &p = out.proc;
+    p.pid = pid;
+
+    ProcStatFields stat;
+    if (readProcStat(dir.fd(), stat)) {
+        p.state = procStateName(stat.state);
+        p.parentPid = stat.parentPid;
+        p.nice = stat.nice;
+        p.threads = stat.threads;
+        p.startTime = stat.startTime;
+        p.virtualMemoryKb = (long)(stat.vsizeBytes / 1024);
+        p.residentSetSizeKb = stat.rssPages * pageKb;
+        p.memoryUsageKb = p.residentSetSizeKb;
+        out.cpuTicks = stat.utime + stat.stime;
+        out.statRead = true;
+    }
+    p.elapsedTime = static_cast<float>(uptime - p.startTime) / clkTck;
+
+    ProcStaticInfo info{};
+    auto cached = procStaticCache.find(pid);
+    if (cached != procStaticCache.end() && cached->second.startTime == p.startTime) info = cached->second;
+    uint32_t loaded = info.loaded;
+    readProcStaticInfo(dir.fd(), info, fields);
+    out.staticRead = info.loaded & ~loaded;
+    applyProcStaticInfo(p, std::move(info));
+    if (fields & FIELD_CGROUP) p.cgroup = getCgroup(dir.fd());
+
+    // Only the real UID is still taken from status; it sits near the top.
+    if (fields & FIELD_UID) {
+        std::string_view text;
+        if (readSmallFile(dir.fd(), "status", text)) {
+            p.uid = (int)parseLeadingInt(findKeyValue(text, "Uid"), p.uid);
         }
     }
-    long uptime = getSystemUptime();
-    p.elapsedTime = static_cast<float>(uptime - p.startTime) / sysconf(_SC_CLK_TCK);
-    std::ifstream statusFile(procPath + "/status");
-    std::string line;
-    int fieldsFound = 0;
-    while (fieldsFound < 6 && std::getline(statusFile, line)) {
-        if (line.compare(0, 4, "Uid:") == 0) { p.uid = std::stoi(line.substr(5)); fieldsFound++; }
-        else if (line.compare(0, 5, "PPid:") == 0) { p.parentPid = std::stoi(line.substr(6)); fieldsFound++; }
-        else if (line.compare(0, 6, "VmRSS:") == 0) { p.residentSetSizeKb = std::stol(line.substr(7)); p.memoryUsageKb = p.residentSetSizeKb; fieldsFound++; }
-        else if (line.compare(0, 7, "VmSize:") == 0) { p.virtualMemoryKb = std::stol(line.substr(8)); fieldsFound++; }
-        else if (line.compare(0, 8, "Threads:") == 0) { p.threads = std::stoi(line.substr(9)); fieldsFound++; }
-        else if (line.compare(0, 6, "State:") == 0) { p.state = line.substr(7); fieldsFound++; }
-    }
-    p.cpuUsage = calculateProcessCpuUsage(pid);
-    p.isForeground = isForegroundProcess(pid);
-    p.cgroup = getCgroup(pid);
-    p.executablePath = getExecutablePath(pid);
-    return p;
-}
-
-json procToJson(const Proc &p) {
-    return {
-        {"pid", p.pid}, {"name", p.name}, {"nice", p.nice}, {"uid", p.uid},
-        {"cpuUsage", p.cpuUsage}, {"parentPid", p.parentPid}, {"isForeground", p.isForeground},
-        {"memoryUsageKb", p.memoryUsageKb}, {"cmdLine", p.cmdLine}, {"state", p.state},
-        {"threads", p.threads}, {"startTime", p.startTime}, {"elapsedTime", p.elapsedTime},
-        {"residentSetSizeKb", p.residentSetSizeKb}, {"virtualMemoryKb", p.virtualMemoryKb},
-        {"cgroup", p.cgroup}, {"executablePath", p.executablePath}
+
+    if (fields & FIELD_IS_FOREGROUND) p.isForeground = isForegroundProcess(dir.fd());
+}
+
+static void commitProcScan(ProcScan &scan, long uptime) {
+    Proc &p = scan.proc;
+    if (scan.statRead) p.cpuUsage = trackProcessCpuUsage(p.pid, p.startTime, scan.cpuTicks, uptime);
+
+    auto cached = procStaticCache.find(p.pid);
+    if (cached != procStaticCache.end() && cached->second.startTime == p.startTime) {
+        cached->second.generation = procScanGeneration;
+        storeProcStaticInfo(cached->second, p, scan.staticRead);
+    } else if (p.elapsedTime >= PROC_STATIC_MIN_AGE_SEC) {
+        ProcStaticInfo info{};
+        info.startTime = p.startTime;
+        info.generation = procScanGeneration;
+        storeProcStaticInfo(info, p, scan.staticRead);
+        procStaticCache.insert_or_assign(p.pid, std::move(info));
+    } else if (cached != procStaticCache.end()) {
+        procStaticCache.erase(cached);
+    }
+}
+
+// Reading a few hundred tiny procfs files is dominated by syscall latency, so
+// the scan is spread over a handful of threads; more than four buys little on
+// phones where the extra cores are the slow ones.
+static WorkerPool &scanPool() {
+    static constexpr unsigned MAX_SCAN_THREADS = 4;
+    static WorkerPool pool(std::min(std::max(std::thread::hardware_concurrency(), 1u), MAX_SCAN_THREADS) - 1);
+    return pool;
+}
+
+json procToJson(const Proc &p, uint32_t fields = FIELD_ALL) {
+    json j = json::object();
+    j["pid"] = p.pid;
+    if (fields & FIELD_NAME) j["name"] = p.name;
+    if (fields & FIELD_NICE) j["nice"] = p.nice;
+    if (fields & FIELD_UID) j["uid"] = p.uid;
+    if (fields & FIELD_CPU_USAGE) j["cpuUsage"] = p.cpuUsage;
+    if (fields & FIELD_PARENT_PID) j["parentPid"] = p.parentPid;
+    if (fields & FIELD_IS_FOREGROUND) j["isForeground"] = p.isForeground;
+    if (fields & FIELD_MEMORY_USAGE) j["memoryUsageKb"] = p.memoryUsageKb;
+    if (fields & FIELD_CMDLINE) j["cmdLine"] = p.cmdLine;
+    if (fields & FIELD_STATE) j["state"] = p.state;
+    if (fields & FIELD_THREADS) j["threads"] = p.threads;
+    if (fields & FIELD_START_TIME) j["startTime"] = p.startTime;
+    if (fields & FIELD_ELAPSED_TIME) j["elapsedTime"] = p.elapsedTime;
+    if (fields & FIELD_RSS) j["residentSetSizeKb"] = p.residentSetSizeKb;
+    if (fields & FIELD_VSIZE) j["virtualMemoryKb"] = p.virtualMemoryKb;
+    if (fields & FIELD_CGROUP) j["cgroup"] = p.cgroup;
+    if (fields & FIELD_EXECUTABLE_PATH) j["executablePath"] = p.executablePath;
+    return j;
+}
+
+// Streaming counterpart of procToJson, used for LIST_PROCESS replies.
+static void writeProcJson(JsonWriter &w, const Proc &p, uint32_t fields) {
+    w.beginObject();
+    w.field("pid", p.pid);
+    if (fields & FIELD_NAME) w.field("name", p.name);
+    if (fields & FIELD_NICE) w.field("nice", p.nice);
+    if (fields & FIELD_UID) w.field("uid", p.uid);
+    if (fields & FIELD_CPU_USAGE) w.field("cpuUsage", p.cpuUsage);
+    if (fields & FIELD_PARENT_PID) w.field("parentPid", p.parentPid);
+    if (fields & FIELD_IS_FOREGROUND) w.field("isForeground", p.isForeground);
+    if (fields & FIELD_MEMORY_USAGE) w.field("memoryUsageKb", p.memoryUsageKb);
+    if (fields & FIELD_CMDLINE) w.field("cmdLine", p.cmdLine);
+    if (fields & FIELD_STATE) w.field("state", p.state);
+    if (fields & FIELD_THREADS) w.field("threads", p.threads);
+    if (fields & FIELD_START_TIME) w.field("startTime", p.startTime);
+    if (fields & FIELD_ELAPSED_TIME) w.field("elapsedTime", p.elapsedTime);
+    if (fields & FIELD_RSS) w.field("residentSetSizeKb", p.residentSetSizeKb);
+    if (fields & FIELD_VSIZE) w.field("virtualMemoryKb", p.virtualMemoryKb);
+    if (fields & FIELD_CGROUP) w.field("cgroup", p.cgroup);
+    if (fields & FIELD_EXECUTABLE_PATH) w.field("executablePath", p.executablePath);
+    w.endObject();
+}
+
+static JsonWriter listWriter(send_chunk);
+
+bool sendProcessListJson(const std::vector<Proc> &procs, uint32_t fields, size_t total) {
+    listWriter.reset();
+    listWriter.beginObject();
+    listWriter.field("type", "PROCESS_LIST");
+    listWriter.field("total", (long long)total);
+    listWriter.key("processes");
+    listWriter.beginArray();
+    for (const auto &p : procs) writeProcJson(listWriter, p, fields);
+    listWriter.endArray();
+    listWriter.endObject();
+    return listWriter.finishLine();
+}
+
+// Binary counterpart of procToJson; see FRAME_PROCESS_LIST in wire.h.
+static void putProcRecord(FrameWriter &w, const Proc &p, uint32_t fields) {
+    if (fields & FIELD_PID) w.putI32(p.pid);
+    if (fields & FIELD_NAME) w.putStr(p.name);
+    if (fields & FIELD_NICE) w.putI32(p.nice);
+    if (fields & FIELD_UID) w.putI32(p.uid);
+    if (fields & FIELD_CPU_USAGE) w.putF32(p.cpuUsage);
+    if (fields & FIELD_PARENT_PID) w.putI32(p.parentPid);
+    if (fields & FIELD_IS_FOREGROUND) w.putU8(p.isForeground ? 1 : 0);
+    if (fields & FIELD_MEMORY_USAGE) w.putI64(p.memoryUsageKb);
+    if (fields & FIELD_CMDLINE) w.putStr(p.cmdLine);
+    if (fields & FIELD_STATE) w.putU8(p.state.empty() ? '?' : p.state[0]);
+    if (fields & FIELD_THREADS) w.putI32(p.threads);
+    if (fields & FIELD_START_TIME) w.putI64(p.startTime);
+    if (fields & FIELD_ELAPSED_TIME) w.putF32(p.elapsedTime);
+    if (fields & FIELD_RSS) w.putI64(p.residentSetSizeKb);
+    if (fields & FIELD_VSIZE) w.putI64(p.virtualMemoryKb);
+    if (fields & FIELD_CGROUP) w.putStr(p.cgroup);
+    if (fields & FIELD_EXECUTABLE_PATH) w.putStr(p.executablePath);
+}
+
+bool sendProcessListFrame(const std::vector<Proc> &procs, uint32_t fields, size_t total) {
+    fields |= FIELD_PID;
+    frameWriter.begin(FRAME_PROCESS_LIST);
+    frameWriter.putU32(fields);
+    frameWriter.putU32((uint32_t)total);
+    frameWriter.putU32((uint32_t)procs.size());
+    for (const auto &p : procs) putProcRecord(frameWriter, p, fields);
+    return send_frame(frameWriter);
+}
+
+// Server-side shaping of a LIST_PROCESS reply: which fields to read and send,
+// which processes to keep and how many of the top entries to return.
+struct ProcQuery {
+    uint32_t fields = FIELD_ALL;
+    ProcField sortBy = FIELD_PID;
+    bool sorted = false;
+    bool descending = true;
+    size_t limit = 0;
+    std::vector<int> uids;
+    std::string nameContains;
+    bool foregroundOnly = false;
+
+    // Fields readProc has to fill for filtering and sorting on top of the
+    // ones that are sent back.
+    uint32_t readFields() const {
+        uint32_t f = fields;
+        if (sorted) f |= sortBy;
+        if (!uids.empty()) f |= FIELD_UID;
+        if (!nameContains.empty()) f |= FIELD_NAME | FIELD_CMDLINE;
+        if (foregroundOnly) f |= FIELD_IS_FOREGROUND;
+        return f;
+    }
+};
+
+// Reads fields, sortBy, order ("asc"/"desc"), limit, uidFilter (a uid or an
+// array of uids), nameContains and foregroundOnly from a request.
+ProcQuery parseProcQuery(const RequestScanner &req) {
+    ProcQuery q;
+    if (req.has("fields")) q.fields = parseProcFields(req.parse("fields"));
+
+    std::string_view sortBy = req.str("sortBy");
+    for (const auto &entry : procFieldKeys) {
+        if (sortBy == entry.key) { q.sortBy = entry.field; q.sorted = true; break; }
+    }
+    q.descending = req.str("order", q.sortBy == FIELD_NAME ? "asc" : "desc") != "asc";
+
+    long long limit = req.integer("limit", 0);
+    if (limit > 0) q.limit = (size_t)limit;
+
+    auto uidFilter = req.parse("uidFilter");
+    if (uidFilter.is_number_integer()) {
+        q.uids.push_back(uidFilter.get<int>());
+    } else if (uidFilter.is_array()) {
+        for (const auto &uid : uidFilter) if (uid.is_number_integer()) q.uids.push_back(uid.get<int>());
+    }
+
+    q.nameContains = toLower(req.string("nameContains"));
+    q.foregroundOnly = req.boolean("foregroundOnly", false);
+    return q;
+}
+
+// Same match as the app's search box: case-insensitive on name or cmdline.
+static bool procMatches(const Proc &p, const ProcQuery &q) {
+    if (q.foregroundOnly && !p.isForeground) return false;
+    if (!q.uids.empty() && std::find(q.uids.begin(), q.uids.end(), p.uid) == q.uids.end()) return false;
+    if (!q.nameContains.empty() &&
+        toLower(p.name).find(q.nameContains) == std::string::npos &&
+        toLower(p.cmdLine).find(q.nameContains) == std::string::npos) {
+        return false;
+    }
+    return true;
+}
+
+static double procSortValue(const Proc &p, ProcField field) {
+    switch (field) {
+        case FIELD_NICE: return p.nice;
+        case FIELD_UID: return p.uid;
+        case FIELD_CPU_USAGE: return p.cpuUsage;
+        case FIELD_PARENT_PID: return p.parentPid;
+        case FIELD_IS_FOREGROUND: return p.isForeground;
+        case FIELD_MEMORY_USAGE: return (double)p.memoryUsageKb;
+        case FIELD_THREADS: return p.threads;
+        case FIELD_START_TIME: return (double)p.startTime;
+        case FIELD_ELAPSED_TIME: return p.elapsedTime;
+        case FIELD_RSS: return (double)p.residentSetSizeKb;
+        case FIELD_VSIZE: return (double)p.virtualMemoryKb;
+        default: return p.pid;
+    }
+}
+
+static const std::string &procSortString(const Proc &p, ProcField field) {
+    switch (field) {
+        case FIELD_CMDLINE: return p.cmdLine;
+        case FIELD_STATE: return p.state;
+        case FIELD_CGROUP: return p.cgroup;
+        case FIELD_EXECUTABLE_PATH: return p.executablePath;
+        default: return p.name;
+    }
+}
+
+static void sortProcs(std::vector<Proc> &procs, const ProcQuery &q) {
+    constexpr uint32_t stringFields = FIELD_NAME | FIELD_CMDLINE | FIELD_STATE | FIELD_CGROUP | FIELD_EXECUTABLE_PATH;
+    bool byString = (q.sortBy & stringFields) != 0;
+    auto less = [&](const Proc &a, const Proc &b) {
+        if (byString) {
+            int c = strcasecmp(procSortString(a, q.sortBy).c_str(), procSortString(b, q.sortBy).c_str());
+            if (c != 0) return q.descending ? c > 0 : c < 0;
+        } else {
+            double va = procSortValue(a, q.sortBy), vb = procSortValue(b, q.sortBy);
+            if (va != vb) return q.descending ? va > vb : va < vb;
+        }
+        return a.pid < b.pid;
     };
+
+    // Top-N only needs the first `limit` entries in order.
+    if (q.limit > 0 && q.limit < procs.size()) {
+        std::partial_sort(procs.begin(), procs.begin() + (long)q.limit, procs.end(), less);
+        procs.resize(q.limit);
+    } else {
+        std::sort(procs.begin(), procs.end(), less);
+    }
 }
 
-std::vector<Proc> collectProcs() {
+// total, when given, receives the number of processes that matched the
+// filters before the limit was applied.
+std::vector<Proc> collectProcs(const ProcQuery &query = {}, size_t *total = nullptr) {
+    static std::vector<int> pids;
+    static std::vector<ProcScan> scans;
     std::vector<Proc> procs;
-    std::vector<int> pids = listPids();
+    listPids(pids);
+    scans.resize(pids.size());
+    procScanGeneration++;
+    long uptime = getSystemUptime();
+    uint32_t fields = query.readFields();
+
+    // Each slot is written by exactly one worker, so the scan needs no locks;
+    // the shared tables are only touched in the serial pass below.
+    scanPool().parallelFor(pids.size(), [&](size_t i) {
+        try {
+            scanProc(pids[i], uptime, fields, scans[i]);
+        } catch (...) {
+            scans[i].statRead = false;
+            scans[i].proc.pid = 0;
+        }
+    });
+
     procs.reserve(pids.size());
-    for (int pid : pids) { try { procs.push_back(readProc(pid)); } catch (...) {} }
+    for (ProcScan &scan : scans) {
+        if (scan.proc.pid == 0) continue;
+        commitProcScan(scan, uptime);
+        if (procMatches(scan.proc, query)) procs.push_back(std::move(scan.proc));
+    }
+    pruneProcessCpuTable();
+    pruneProcessStaticCache();
+
+    if (total) *total = procs.size();
+    if (query.sorted) {
+        sortProcs(procs, query);
+    } else if (query.limit > 0 && query.limit < procs.size()) {
+        procs.resize(query.limit);
+    }
     return procs;
 }
 
-void getSwapUsage(long &used, long &total) {
-    used = 0; total = 0;
-    std::ifstream meminfo("/proc/meminfo");
-    if (!meminfo.is_open()) return;
-    long totalKB = 0, freeKB = 0;
-    std::string line;
-    while (std::getline(meminfo, line)) {
-        if (line.compare(0, 10, "SwapTotal:") == 0) totalKB = std::stol(line.substr(10));
-        else if (line.compare(0, 9, "SwapFree:") == 0) freeKB = std::stol(line.substr(9));
+// Last snapshot handed out by LIST_PROCESS_DELTA. Clients echo the generation
+// they hold; any mismatch gets a full resync instead of a diff.
+static std::unordered_map<int, Proc> deltaSnapshot;
+static uint64_t deltaGeneration = 0;
+
+// cpuUsage moves by tiny amounts on idle processes; smaller changes are not
+// worth a line on the wire.
+static constexpr float DELTA_CPU_EPSILON = 0.05f;
+
+// Fields of curr that differ from prev, plus the pid. elapsedTime is left out
+// on purpose: it changes on every refresh and clients derive it from the
+// uptime sent with the delta. Returns an empty object when nothing changed.
+static json procDiffToJson(const Proc &prev, const Proc &curr) {
+    json d = json::object();
+    if (prev.name != curr.name) d["name"] = curr.name;
+    if (prev.nice != curr.nice) d["nice"] = curr.nice;
+    if (prev.uid != curr.uid) d["uid"] = curr.uid;
+    if (std::fabs(prev.cpuUsage - curr.cpuUsage) >= DELTA_CPU_EPSILON) d["cpuUsage"] = curr.cpuUsage;
+    if (prev.parentPid != curr.parentPid) d["parentPid"] = curr.parentPid;
+    if (prev.isForeground != curr.isForeground) d["isForeground"] = curr.isForeground;
+    if (prev.memoryUsageKb != curr.memoryUsageKb) d["memoryUsageKb"] = curr.memoryUsageKb;
+    if (prev.cmdLine != curr.cmdLine) d["cmdLine"] = curr.cmdLine;
+    if (prev.state != curr.state) d["state"] = curr.state;
+    if (prev.threads != curr.threads) d["threads"] = curr.threads;
+    if (prev.residentSetSizeKb != curr.residentSetSizeKb) d["residentSetSizeKb"] = curr.residentSetSizeKb;
+    if (prev.virtualMemoryKb != curr.virtualMemoryKb) d["virtualMemoryKb"] = curr.virtualMemoryKb;
+    if (prev.cgroup != curr.cgroup) d["cgroup"] = curr.cgroup;
+    if (prev.executablePath != curr.executablePath) d["executablePath"] = curr.executablePath;
+    if (!d.empty()) d["pid"] = curr.pid;
+    return d;
+}
+
+// Builds a PROCESS_DELTA reply against the stored snapshot and replaces the
+// snapshot with procs. The snapshot mirrors what the client holds, so a
+// cpuUsage change below DELTA_CPU_EPSILON keeps the old value as the
+// baseline and small moves still add up to a reported change. A PID whose
+// startTime changed was reused by a new process and appears in both removed
+// and added; clients must apply removed before added.
+json buildProcessDelta(std::vector<Proc> &&procs, uint64_t clientGeneration, long uptime) {
+    bool full = clientGeneration != deltaGeneration || deltaSnapshot.empty();
+    json added = json::array();
+    json changed = json::array();
+    json removed = json::array();
+
+    std::unordered_map<int, Proc> next;
+    next.reserve(procs.size());
+    for (auto &p : procs) {
+        auto it = full ? deltaSnapshot.end() : deltaSnapshot.find(p.pid);
+        if (it == deltaSnapshot.end()) {
+            added.push_back(procToJson(p));
+        } else if (it->second.startTime != p.startTime) {
+            removed.push_back(p.pid);
+            added.push_back(procToJson(p));
+        } else {
+            json d = procDiffToJson(it->second, p);
+            if (!d.contains("cpuUsage")) p.cpuUsage = it->second.cpuUsage;
+            if (!d.empty()) changed.push_back(std::move(d));
+        }
+        next.emplace(p.pid, std::move(p));
+    }
+    if (!full) {
+        for (const auto &entry : deltaSnapshot) {
+            if (next.find(entry.first) == next.end()) removed.push_back(entry.first);
+        }
     }
+
+    deltaSnapshot = std::move(next);
+    deltaGeneration++;
+
+    json j_out;
+    j_out["type"] = "PROCESS_DELTA";
+    j_out["full"] = full;
+    j_out["generation"] = deltaGeneration;
+    j_out["uptime"] = uptime;
+    j_out["clkTck"] = sysconf(_SC_CLK_TCK);
+    j_out["added"] = std::move(added);
+    j_out["changed"] = std::move(changed);
+    j_out["removed"] = std::move(removed);
+    return j_out;
+}
+
+// /proc/meminfo keys kept in MemInfo, as (meminfo key, member). The member
+// name doubles as the JSON key; every value is in kB.
+#define MEMINFO_FIELDS(X) \
+    X("MemTotal", memTotal) \
+    X("MemFree", memFree) \
+    X("MemAvailable", memAvailable) \
+    X("Buffers", buffers) \
+    X("Cached", cached) \
+    X("SwapCached", swapCached) \
+    X("Active", active) \
+    X("Inactive", inactive) \
+    X("Active(anon)", activeAnon) \
+    X("Inactive(anon)", inactiveAnon) \
+    X("Active(file)", activeFile) \
+    X("Inactive(file)", inactiveFile) \
+    X("Dirty", dirty) \
+    X("Writeback", writeback) \
+    X("Shmem", shmem) \
+    X("Slab", slab) \
+    X("SReclaimable", sReclaimable) \
+    X("SUnreclaim", sUnreclaim) \
+    X("SwapTotal", swapTotal) \
+    X("SwapFree", swapFree)
+
+// One parse of /proc/meminfo plus the zram device's mm_stat. Counters the
+// kernel does not report are -1.
+struct MemInfo {
+#define MEMINFO_MEMBER(key, member) long long member = -1;
+    MEMINFO_FIELDS(MEMINFO_MEMBER)
+#undef MEMINFO_MEMBER
+    // From /sys/block/zram0/mm_stat, converted to kB: uncompressed size of
+    // the swapped data, its compressed size, and the memory zram really uses.
+    long long zramOrig = -1;
+    long long zramCompressed = -1;
+    long long zramUsed = -1;
+};
+
+#define MEMINFO_COUNT(key, member) +1
+static constexpr uint8_t MEMINFO_FIELD_COUNT = 0 MEMINFO_FIELDS(MEMINFO_COUNT);
+#undef MEMINFO_COUNT
+
+// Slot for a meminfo key, or nullptr for keys MemInfo does not keep. Same
+// compile-time hash switch as command dispatch.
+static long long *memInfoField(MemInfo &info, std::string_view key) {
+#define MEMINFO_CASE(str, member) case hashCommand(str): return key == str ? &info.member : nullptr;
+    switch (hashCommand(key)) {
+        MEMINFO_FIELDS(MEMINFO_CASE)
+        default: return nullptr;
+    }
+#undef MEMINFO_CASE
+}
+
+static void readMemInfo(MemInfo &info) {
+    info = MemInfo{};
+    std::string_view text;
+    if (metricFile(METRIC_FILE_MEMINFO).sample(text)) {
+        const char *p = text.data();
+        const char *end = p + text.size();
+        while (p < end) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!nl) nl = end;
+            const char *colon = static_cast<const char *>(memchr(p, ':', nl - p));
+            if (colon) {
+                long long *field = memInfoField(info, std::string_view(p, colon - p));
+                if (field) *field = parseLeadingInt(std::string_view(colon + 1, nl - colon - 1), -1);
+            }
+            p = nl + 1;
+        }
+    }
+
+    if (metricFile(METRIC_FILE_ZRAM_MM_STAT).sample(text)) {
+        const char *p = text.data();
+        const char *end = p + text.size();
+        unsigned long long bytes[3];
+        for (auto &value : bytes) p = parseUnsigned(skipSpaces(p, end), end, value);
+        info.zramOrig = (long long)(bytes[0] / 1024);
+        info.zramCompressed = (long long)(bytes[1] / 1024);
+        info.zramUsed = (long long)(bytes[2] / 1024);
+    }
+}
+
+// MEMINFO, SWAP_PING and the swap/meminfo subscription metrics all read the
+// same snapshot; it is re-parsed only once it is older than MAX_AGE, so a
+// tick that samples several of them parses the files once.
+static const MemInfo &memInfoSnapshot() {
+    static constexpr auto MAX_AGE = std::chrono::milliseconds(50);
+    static MemInfo info;
+    static std::chrono::steady_clock::time_point readAt;
+    static bool valid = false;
+    auto now = std::chrono::steady_clock::now();
+    if (!valid || now - readAt >= MAX_AGE) {
+        readMemInfo(info);
+        readAt = now;
+        valid = true;
+    }
+    return info;
+}
+
+static json memInfoToJson(const MemInfo &info) {
+    json j;
+#define MEMINFO_JSON(key, member) j[#member] = info.member;
+    MEMINFO_FIELDS(MEMINFO_JSON)
+#undef MEMINFO_JSON
+    if (info.zramOrig >= 0) {
+        j["zram"] = {{"orig", info.zramOrig}, {"compressed", info.zramCompressed}, {"used", info.zramUsed}};
+    } else {
+        j["zram"] = nullptr;
+    }
+    return j;
+}
+
+static void putMemInfo(FrameWriter &w, const MemInfo &info) {
+    w.putU8(MEMINFO_FIELD_COUNT);
+#define MEMINFO_PUT(key, member) w.putI64(info.member);
+    MEMINFO_FIELDS(MEMINFO_PUT)
+#undef MEMINFO_PUT
+    w.putI64(info.zramOrig);
+    w.putI64(info.zramCompressed);
+    w.putI64(info.zramUsed);
+}
+
+void getSwapUsage(long &used, long &total) {
+    const MemInfo &info = memInfoSnapshot();
+    long totalKB = (long)std::max(info.swapTotal, 0LL);
+    long freeKB = (long)std::max(info.swapFree, 0LL);
     used = (totalKB - freeKB) * 1024;
     total = totalKB * 1024;
 }
@@ -447,206 +1713,751 @@ struct NetStat {
     unsigned long long txBytes;
 };
 
-struct NetInterfaceInfo {
+// Byte counters from the part of a /proc/net/dev line after the colon:
+// rx bytes is the first column and tx bytes the ninth.
+static NetStat parseNetDevCounters(std::string_view counters) {
+    const char *p = counters.data();
+    const char *end = p + counters.size();
+    unsigned long long v[9] = {};
+    for (auto &field : v) {
+        while (p < end && (*p == ' ' || *p == '\t')) ++p;
+        p = parseUnsigned(p, end, field);
+    }
+    return {v[0], v[8]};
+}
+
+// One slot per interface ever seen in /proc/net/dev. A slot keeps its index
+// for the daemon's lifetime, so an interface that goes away and comes back
+// reuses it; present says whether the latest parse listed it.
+struct NetInterfaceSlot {
     std::string name;
-    unsigned long long totalBytes;
+    bool present;
+    NetStat bytes;
+    double rxBytesPerSec;
+    double txBytesPerSec;
 };
 
-std::vector<NetInterfaceInfo> listNetInterfaces() {
-    std::vector<NetInterfaceInfo> interfaces;
-    std::ifstream netdev("/proc/net/dev");
-    std::string line;
-    if (!netdev.is_open()) return interfaces;
+static std::vector<NetInterfaceSlot> netSlots;
+static std::chrono::steady_clock::time_point netSampledAt;
+static bool netSampled = false;
 
-    std::getline(netdev, line);
-    std::getline(netdev, line);
-    while (std::getline(netdev, line)) {
-        size_t colon = line.find(':');
-        if (colon != std::string::npos) {
-            std::string name = line.substr(0, colon);
-            name.erase(0, name.find_first_not_of(' '));
-            if (name == "lo") continue;
+// Requests closer together than this share one parse (and its rates), so
+// pinging several interfaces back to back still measures a real interval.
+static constexpr auto NET_MIN_SAMPLE_INTERVAL = std::chrono::milliseconds(100);
 
-            std::istringstream iss(line.substr(colon + 1));
-            unsigned long long rxBytes, txBytes, dummy;
-            iss >> rxBytes;
-            for(int i=0; i<7; ++i) iss >> dummy;
-            iss >> txBytes;
+static NetInterfaceSlot &netSlot(std::string_view name) {
+    for (auto &slot : netSlots) {
+        if (slot.name == name) return slot;
+    }
+    netSlots.push_back({std::string(name), false, {0, 0}, 0.0, 0.0});
+    return netSlots.back();
+}
 
-            interfaces.push_back({name, rxBytes + txBytes});
+// Parses /proc/net/dev once for every interface. Rates cover the time since
+// the previous parse and are 0 for an interface that was absent from it or
+// whose counters went backwards (the device was recreated).
+static void sampleNetStats() {
+    auto now = std::chrono::steady_clock::now();
+    if (netSampled && now - netSampledAt < NET_MIN_SAMPLE_INTERVAL) return;
+    double elapsed = netSampled ? std::chrono::duration<double>(now - netSampledAt).count() : 0.0;
+    netSampledAt = now;
+    netSampled = true;
+
+    std::vector<bool> seen(netSlots.size(), false);
+    std::string_view text;
+    if (metricFile(METRIC_FILE_NET_DEV).sample(text)) {
+        for (size_t pos = 0; pos < text.size();) {
+            size_t nl = text.find('\n', pos);
+            std::string_view line = text.substr(pos, nl == std::string_view::npos ? std::string_view::npos : nl - pos);
+            pos = nl == std::string_view::npos ? text.size() : nl + 1;
+
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos) continue;
+            std::string_view name = line.substr(0, colon);
+            while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+
+            NetInterfaceSlot &slot = netSlot(name);
+            size_t index = &slot - netSlots.data();
+            if (index >= seen.size()) seen.resize(index + 1, false);
+            seen[index] = true;
+
+            NetStat curr = parseNetDevCounters(line.substr(colon + 1));
+            bool comparable = slot.present && elapsed > 0.0 &&
+                              curr.rxBytes >= slot.bytes.rxBytes && curr.txBytes >= slot.bytes.txBytes;
+            slot.rxBytesPerSec = comparable ? (curr.rxBytes - slot.bytes.rxBytes) / elapsed : 0.0;
+            slot.txBytesPerSec = comparable ? (curr.txBytes - slot.bytes.txBytes) / elapsed : 0.0;
+            slot.bytes = curr;
         }
     }
-    return interfaces;
+    for (size_t i = 0; i < netSlots.size(); ++i) netSlots[i].present = seen[i];
+}
+
+static json netSlotToJson(const NetInterfaceSlot &slot) {
+    return {{"name", slot.name},
+            {"rxBytes", slot.bytes.rxBytes},
+            {"txBytes", slot.bytes.txBytes},
+            {"rxBytesPerSec", slot.rxBytesPerSec},
+            {"txBytesPerSec", slot.txBytesPerSec}};
+}
+
+
+// Metrics a SUBSCRIBE request can ask the daemon to push on its own timer.
+enum Metric : uint32_t {
+    METRIC_CPU = 1u << 0,
+    METRIC_PER_CORE_CPU = 1u << 1,
+    METRIC_SWAP = 1u << 2,
+    METRIC_GPU = 1u << 3,
+    METRIC_CPU_TEMP = 1u << 4,
+    METRIC_PID_CPU = 1u << 5,
+    METRIC_MEMINFO = 1u << 6,
+};
+
+static const struct {
+    const char *key;
+    Metric metric;
+} metricKeys[] = {
+    {"cpu", METRIC_CPU}, {"perCoreCpu", METRIC_PER_CORE_CPU}, {"swap", METRIC_SWAP},
+    {"gpu", METRIC_GPU}, {"cpuTemp", METRIC_CPU_TEMP}, {"pidCpu", METRIC_PID_CPU},
+    {"meminfo", METRIC_MEMINFO},
+};
+
+// The single active subscription, driven by a periodic timerfd so ticks keep
+// their spacing no matter how long a sample takes.
+struct Subscription {
+    static constexpr int MIN_INTERVAL_MS = 16;
+    static constexpr int MAX_INTERVAL_MS = 60000;
+
+    bool active = false;
+    uint32_t metrics = 0;
+    int intervalMs = 1000;
+    int pid = -1;
+    uint64_t seq = 0;
+    int timerFd = -1;
+};
+
+static Subscription subscription;
+
+static json metricsToJson(uint32_t metrics) {
+    json arr = json::array();
+    for (const auto &entry : metricKeys) if (metrics & entry.metric) arr.push_back(entry.key);
+    return arr;
 }
 
-NetStat getNetStat(const std::string& iface) {
-    std::ifstream netdev("/proc/net/dev");
-    std::string line;
-    while (std::getline(netdev, line)) {
-        if (line.find(iface + ":") != std::string::npos) {
-            std::istringstream iss(line.substr(line.find(':') + 1));
-            unsigned long long rxBytes, dummy;
-            unsigned long long txBytes;
-            iss >> rxBytes;
-            for(int i=0; i<7; ++i) iss >> dummy;
-            iss >> txBytes;
-            return {rxBytes, txBytes};
+// Samples every subscribed metric into one SAMPLES line.
+void pushSubscriptionSamples() {
+    uint32_t m = subscription.metrics;
+    uint64_t seq = subscription.seq++;
+
+    CpuSampler::Sample cpu{};
+    long swapUsed = 0, swapTotal = 0;
+    int gpu = -1, cpuTemp = -1;
+    float pidCpu = 0.0f;
+    if (m & (METRIC_CPU | METRIC_PER_CORE_CPU)) cpu = cpuSampler.latest();
+    if (m & METRIC_SWAP) getSwapUsage(swapUsed, swapTotal);
+    if (m & METRIC_GPU) gpu = calculateGpuUsage();
+    if (m & METRIC_CPU_TEMP) cpuTemp = getCpuTemperatureCelsius();
+    if (m & METRIC_PID_CPU) pidCpu = calculateProcessCpuUsage(subscription.pid);
+
+    if (wireProtocol == WIRE_BINARY) {
+        frameWriter.begin(FRAME_SAMPLES);
+        frameWriter.putU64(seq);
+        frameWriter.putU32(m);
+        if (m & METRIC_CPU) frameWriter.putI32(cpu.usage);
+        if (m & METRIC_PER_CORE_CPU) {
+            frameWriter.putU8((uint8_t)cpu.cores);
+            for (int core = 0; core < cpu.cores; ++core) frameWriter.putI8(cpu.coreUsage[core]);
         }
+        if (m & METRIC_SWAP) { frameWriter.putI64(swapUsed); frameWriter.putI64(swapTotal); }
+        if (m & METRIC_GPU) frameWriter.putI32(gpu);
+        if (m & METRIC_CPU_TEMP) frameWriter.putI32(cpuTemp);
+        if (m & METRIC_PID_CPU) { frameWriter.putI32(subscription.pid); frameWriter.putF32(pidCpu); }
+        if (m & METRIC_MEMINFO) putMemInfo(frameWriter, memInfoSnapshot());
+        send_frame(frameWriter, true);
+        return;
+    }
+
+    json j_out;
+    j_out["type"] = "SAMPLES";
+    j_out["seq"] = seq;
+    if (m & METRIC_CPU) j_out["cpu"] = cpu.usage;
+    if (m & METRIC_PER_CORE_CPU) {
+        json cores_j = json::array();
+        for (int core = 0; core < cpu.cores; ++core) cores_j.push_back(cpu.coreUsage[core]);
+        j_out["perCoreCpu"] = cores_j;
     }
-    return {0, 0};
+    if (m & METRIC_SWAP) j_out["swap"] = {{"used", swapUsed}, {"total", swapTotal}};
+    if (m & METRIC_GPU) j_out["gpu"] = gpu;
+    if (m & METRIC_CPU_TEMP) j_out["cpuTemp"] = cpuTemp;
+    if (m & METRIC_PID_CPU) j_out["pidCpu"] = {{"pid", subscription.pid}, {"usage", pidCpu}};
+    if (m & METRIC_MEMINFO) j_out["meminfo"] = memInfoToJson(memInfoSnapshot());
+    send_msg(j_out.dump(), true);
 }
 
-struct NetStatSnapshot {
-    unsigned long long rxBytes;
-    unsigned long long txBytes;
-    std::chrono::steady_clock::time_point timestamp;
-};
+// Arms (intervalMs > 0) or disarms the subscription timer. The first tick
+// fires right away.
+static void setSubscriptionTimer(int intervalMs) {
+    struct itimerspec spec{};
+    if (intervalMs > 0) {
+        spec.it_interval.tv_sec = intervalMs / 1000;
+        spec.it_interval.tv_nsec = (long)(intervalMs % 1000) * 1000000L;
+        spec.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(subscription.timerFd, 0, &spec, nullptr);
+}
+
+// Ticks missed while the loop was busy are collapsed into one sample rather
+// than sent as a burst.
+void onSubscriptionTimer() {
+    uint64_t expirations = 0;
+    if (read(subscription.timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    if (subscription.active) pushSubscriptionSamples();
+}
+
+// pid -> pidfd for every WATCH_PID still pending.
+static std::unordered_map<int, int> watchedPids;
+
+// Starts watching pid for exit. Returns 0 or an errno value.
+int watchPid(int pid) {
+    if (pid <= 0) return EINVAL;
+    if (watchedPids.count(pid)) return 0;
+    int pidfd = pidfdOpen(pid);
+    if (pidfd < 0) return errno;
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = eventData(EVENT_PIDFD, (uint32_t)pid);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pidfd, &ev) != 0) {
+        int err = errno;
+        close(pidfd);
+        return err;
+    }
+    watchedPids[pid] = pidfd;
 
-static std::unordered_map<std::string, NetStatSnapshot> netStatCache;
+    // Keep /proc/<pid> open too, so repeated reads of a watched process skip
+    // the path walk. Opened after the pidfd, so it is the same instance.
+    int procDir = openProcDir(pid);
+    if (procDir >= 0) procDirCache[pid] = procDir;
+    return 0;
+}
 
+void unwatchPid(int pid) {
+    auto it = watchedPids.find(pid);
+    if (it == watchedPids.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second, nullptr);
+    close(it->second);
+    watchedPids.erase(it);
+
+    auto dir = procDirCache.find(pid);
+    if (dir != procDirCache.end()) {
+        close(dir->second);
+        procDirCache.erase(dir);
+    }
+}
+
+// A pidfd turns readable once its process has exited. Events already fetched
+// in the same epoll batch can be stale: the pid may have been unwatched, or
+// unwatched and watched again with a fresh pidfd, so the current pidfd must
+// itself be readable before the exit is reported.
+void handlePidExit(int pid) {
+    auto it = watchedPids.find(pid);
+    if (it == watchedPids.end()) return;
+    struct pollfd pfd = {it->second, POLLIN, 0};
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)) return;
+
+    unwatchPid(pid);
+    json j_out;
+    j_out["type"] = "PROCESS_EXITED";
+    j_out["pid"] = pid;
+    send_json(j_out);
+}
+
+enum class Command {
+    Unknown,
+    Ping,
+    Hello,
+    Kill,
+    ForceStop,
+    ForceStopMany,
+    KillGroup,
+    KillMany,
+    StopSelf,
+    ListProcess,
+    ListProcessDelta,
+    CpuPing,
+    PerCoreCpu,
+    CpuSamplerConfig,
+    Subscribe,
+    Unsubscribe,
+    SwapPing,
+    MemInfo,
+    GpuPing,
+    CtempPing,
+    ThermalZones,
+    PingPidCpu,
+    BatChargeCycles,
+    ListNetInterfaces,
+    NetPing,
+    NetPingAll,
+    WatchPid,
+    UnwatchPid,
+};
+
+// One switch over compile-time hashes; two names colliding would be a
+// duplicate case label, so the table is a perfect hash by construction.
+static Command lookupCommand(std::string_view name) {
+#define COMMAND(str, command) case hashCommand(str): return name == str ? command : Command::Unknown
+    switch (hashCommand(name)) {
+        COMMAND("PING", Command::Ping);
+        COMMAND("HELLO", Command::Hello);
+        COMMAND("KILL", Command::Kill);
+        COMMAND("FORCE_STOP", Command::ForceStop);
+        COMMAND("FORCE_STOP_MANY", Command::ForceStopMany);
+        COMMAND("KILL_GROUP", Command::KillGroup);
+        COMMAND("KILL_MANY", Command::KillMany);
+        COMMAND("STOP_SELF", Command::StopSelf);
+        COMMAND("BUSY", Command::StopSelf);
+        COMMAND("LIST_PROCESS", Command::ListProcess);
+        COMMAND("LIST_PROCESS_DELTA", Command::ListProcessDelta);
+        COMMAND("CPU_PING", Command::CpuPing);
+        COMMAND("PER_CORE_CPU", Command::PerCoreCpu);
+        COMMAND("CPU_SAMPLER_CONFIG", Command::CpuSamplerConfig);
+        COMMAND("SUBSCRIBE", Command::Subscribe);
+        COMMAND("UNSUBSCRIBE", Command::Unsubscribe);
+        COMMAND("SWAP_PING", Command::SwapPing);
+        COMMAND("MEMINFO", Command::MemInfo);
+        COMMAND("GPU_PING", Command::GpuPing);
+        COMMAND("CTEMP_PING", Command::CtempPing);
+        COMMAND("THERMAL_ZONES", Command::ThermalZones);
+        COMMAND("PING_PID_CPU", Command::PingPidCpu);
+        COMMAND("BAT_CHARGE_CYCLES", Command::BatChargeCycles);
+        COMMAND("LIST_NET_INTERFACES", Command::ListNetInterfaces);
+        COMMAND("NET_PING", Command::NetPing);
+        COMMAND("NET_PING_ALL", Command::NetPingAll);
+        COMMAND("WATCH_PID", Command::WatchPid);
+        COMMAND("UNWATCH_PID", Command::UnwatchPid);
+        default: return Command::Unknown;
+    }
+#undef COMMAND
+}
 
 void processCommand(const std::string &received) {
     try {
-        json j_in = json::parse(received);
-        std::string cmd = j_in.value("cmd", "");
+        RequestScanner req(received);
+        if (!req.ok()) {
+            log_line("JSON parse error: malformed request | Data: " + received);
+            return;
+        }
+        std::string_view cmd = req.str("cmd");
         json j_out;
 
-        if (cmd == "PING") {
+        switch (lookupCommand(cmd)) {
+        case Command::Ping: {
             j_out["type"] = "PONG";
             send_json(j_out);
-        } else if (cmd == "KILL") {
-            int pid = j_in.value("pid", -1);
+            break;
+        }
+        case Command::Hello: {
+            // The reply goes out in the format in effect before the switch.
+            std::string_view protocol = req.str("protocol", "json");
+            long long version = req.integer("version", WIRE_VERSION);
+            WireProtocol requested = (protocol == "binary" && version == WIRE_VERSION) ? WIRE_BINARY : WIRE_JSON;
+            j_out["type"] = "HELLO";
+            j_out["protocol"] = requested == WIRE_BINARY ? "binary" : "json";
+            j_out["version"] = WIRE_VERSION;
+            send_json(j_out);
+            wireProtocol = requested;
+            break;
+        }
+        case Command::Kill: {
+            int pid = (int)req.integer("pid", -1);
             bool success = (pid > 0) && killProcess(pid);
             j_out["type"] = "KILL_RESULT";
             j_out["success"] = success;
             send_json(j_out);
-        } else if (cmd == "FORCE_STOP") {
-            std::string pkg = j_in.value("pkg", "");
-            std::regex pkg_regex("^[a-zA-Z0-9._]+$");
-            bool success = false;
-            if (std::regex_match(pkg, pkg_regex) && pkg.length() <= 255) {
-                std::string scmd = "am force-stop " + pkg;
-                success = (system(scmd.c_str()) == 0);
+            break;
+        }
+        case Command::ForceStop: {
+            forceStopPackages({std::string(req.str("pkg"))}, false);
+            break;
+        }
+        case Command::ForceStopMany: {
+            std::vector<std::string> pkgs;
+            auto pkgs_j = req.parse("pkgs");
+            if (pkgs_j.is_array()) {
+                for (const auto &pkg : pkgs_j) if (pkg.is_string()) pkgs.push_back(pkg.get<std::string>());
             }
-            j_out["type"] = "KILL_RESULT";
-            j_out["success"] = success;
+            forceStopPackages(std::move(pkgs), true);
+            break;
+        }
+        case Command::KillMany: {
+            // "pids" holds plain pids or {"pid", "startTime"} objects; with a
+            // startTime the signal is only sent if the PID was not reused.
+            // "results" holds one errno value per entry, in the same order.
+            int sig = (int)req.integer("signal", SIGKILL);
+            auto pids_j = req.parse("pids");
+            json results_j = json::array();
+            bool allKilled = pids_j.is_array() && !pids_j.empty();
+            if (pids_j.is_array()) {
+                for (const auto &entry : pids_j) {
+                    // A malformed entry gets EINVAL rather than failing the
+                    // whole reply.
+                    int pid = -1;
+                    long startTime = -1;
+                    bool valid = true;
+                    if (entry.is_number_integer()) {
+                        pid = entry.get<int>();
+                    } else if (entry.is_object()) {
+                        auto pid_j = entry.find("pid");
+                        auto startTime_j = entry.find("startTime");
+                        if (pid_j != entry.end() && pid_j->is_number_integer()) pid = pid_j->get<int>();
+                        else valid = false;
+                        if (startTime_j != entry.end()) {
+                            if (startTime_j->is_number_integer()) startTime = startTime_j->get<long>();
+                            else valid = false;
+                        }
+                    } else {
+                        valid = false;
+                    }
+                    int err = (valid && sig > 0 && sig < NSIG) ? signalProcess(pid, sig, startTime) : EINVAL;
+                    results_j.push_back(err);
+                    allKilled = allKilled && err == 0;
+                }
+            }
+            j_out["type"] = "KILL_MANY_RESULT";
+            j_out["success"] = allKilled;
+            j_out["results"] = results_j;
             send_json(j_out);
-        } else if (cmd == "KILL_GROUP") {
-            int pgid = j_in.value("pgid", -1);
+            break;
+        }
+        case Command::KillGroup: {
+            int pgid = (int)req.integer("pgid", -1);
             bool success = (pgid > 0) ? killProcessGroup(pgid) : false;
             j_out["type"] = "KILL_RESULT";
             j_out["success"] = success;
             send_json(j_out);
-        } else if (cmd == "STOP_SELF" || cmd == "BUSY") {
-            keep_running = 0;
-        } else if (cmd == "LIST_PROCESS") {
+            break;
+        }
+        case Command::StopSelf: {
+            keep_running = false;
+            break;
+        }
+        case Command::ListProcess: {
+            ProcQuery query = parseProcQuery(req);
+            size_t total = 0;
+            auto procs = collectProcs(query, &total);
+            if (wireProtocol == WIRE_BINARY) sendProcessListFrame(procs, query.fields, total);
+            else sendProcessListJson(procs, query.fields, total);
+            break;
+        }
+        case Command::ListProcessDelta: {
+            // "generation" is the last one the client applied; omit it (or
+            // send 0) to request a full resync.
+            uint64_t generation = (uint64_t)req.integer("generation", 0);
             auto procs = collectProcs();
-            json procs_j = json::array();
-            for (const auto &p : procs) procs_j.push_back(procToJson(p));
-            j_out["type"] = "PROCESS_LIST";
-            j_out["processes"] = procs_j;
-            send_json(j_out);
-        } else if (cmd == "CPU_PING") {
+            send_json(buildProcessDelta(std::move(procs), generation, getSystemUptime()));
+            break;
+        }
+        case Command::CpuPing: {
             j_out["type"] = "CPU_USAGE";
             j_out["usage"] = calculateCpuUsage();
             send_json(j_out);
-        } else if (cmd == "SWAP_PING") {
+            break;
+        }
+        case Command::PerCoreCpu: {
+            auto sample = cpuSampler.latest();
+            json cores_j = json::array();
+            for (int core = 0; core < sample.cores; ++core) cores_j.push_back(sample.coreUsage[core]);
+            j_out["type"] = "PER_CORE_CPU";
+            j_out["usage"] = sample.usage;
+            j_out["cores"] = cores_j;
+            send_json(j_out);
+            break;
+        }
+        case Command::CpuSamplerConfig: {
+            int intervalMs = (int)req.integer("intervalMs", -1);
+            if (intervalMs > 0) cpuSampler.setIntervalMs(intervalMs);
+            j_out["type"] = "CPU_SAMPLER_CONFIG";
+            j_out["intervalMs"] = cpuSampler.intervalMs();
+            send_json(j_out);
+            break;
+        }
+        case Command::Subscribe: {
+            uint32_t metrics = 0;
+            auto metricNames = req.parse("metrics");
+            if (!metricNames.is_array()) metricNames = json::array();
+            for (const auto &name : metricNames) {
+                if (!name.is_string()) continue;
+                for (const auto &entry : metricKeys) {
+                    if (name == entry.key) { metrics |= entry.metric; break; }
+                }
+            }
+            subscription.pid = (int)req.integer("pid", -1);
+            if (subscription.pid <= 0) metrics &= ~METRIC_PID_CPU;
+            subscription.metrics = metrics;
+            subscription.intervalMs = std::clamp((int)req.integer("intervalMs", 1000),
+                                                 Subscription::MIN_INTERVAL_MS, Subscription::MAX_INTERVAL_MS);
+            subscription.active = metrics != 0;
+            subscription.seq = 0;
+            setSubscriptionTimer(subscription.active ? subscription.intervalMs : 0);
+            j_out["type"] = "SUBSCRIBED";
+            j_out["metrics"] = metricsToJson(metrics);
+            j_out["intervalMs"] = subscription.intervalMs;
+            send_json(j_out);
+            break;
+        }
+        case Command::Unsubscribe: {
+            subscription.active = false;
+            subscription.metrics = 0;
+            setSubscriptionTimer(0);
+            j_out["type"] = "UNSUBSCRIBED";
+            send_json(j_out);
+            break;
+        }
+        case Command::SwapPing: {
             long used, total;
             getSwapUsage(used, total);
             j_out["type"] = "SWAP_USAGE";
             j_out["used"] = used;
             j_out["total"] = total;
             send_json(j_out);
-        } else if (cmd == "GPU_PING") {
+            break;
+        }
+        case Command::MemInfo: {
+            j_out = memInfoToJson(memInfoSnapshot());
+            j_out["type"] = "MEMINFO";
+            send_json(j_out);
+            break;
+        }
+        case Command::GpuPing: {
             j_out["type"] = "GPU_USAGE";
             j_out["usage"] = calculateGpuUsage();
             send_json(j_out);
-        } else if (cmd == "CTEMP_PING") {
+            break;
+        }
+        case Command::CtempPing: {
             j_out["type"] = "CPU_TEMP";
             j_out["temp"] = getCpuTemperatureCelsius();
             send_json(j_out);
-        } else if (cmd == "PING_PID_CPU") {
-            int pid = j_in.value("pid", -1);
+            break;
+        }
+        case Command::ThermalZones: {
+            // Every zone sampled back to back; temp is null for a zone whose
+            // sensor could not be read.
+            json zones_j = json::array();
+            for (ThermalZone &zone : thermalZones()) {
+                json zone_j;
+                double tempC;
+                zone_j["zone"] = zone.index;
+                zone_j["type"] = zone.type;
+                zone_j["kind"] = thermalKindName(zone.kind);
+                zone_j["temp"] = readThermalZone(zone, tempC) ? json(tempC) : json();
+                zones_j.push_back(std::move(zone_j));
+            }
+            j_out["type"] = "THERMAL_ZONES";
+            j_out["zones"] = std::move(zones_j);
+            send_json(j_out);
+            break;
+        }
+        case Command::PingPidCpu: {
+            int pid = (int)req.integer("pid", -1);
             j_out["type"] = "PROCESS_CPU_USAGE";
             j_out["usage"] = calculateProcessCpuUsage(pid);
             send_json(j_out);
-        } else if(cmd == "BAT_CHARGE_CYCLES"){
+            break;
+        }
+        case Command::BatChargeCycles: {
             j_out["type"] = "CHARGE_CYCLES";
             j_out["cycles"] = getBatteryCycleCount().value_or(-1);
             send_json(j_out);
-        } else if (cmd == "LIST_NET_INTERFACES") {
-            auto interfaces = listNetInterfaces();
+            break;
+        }
+        case Command::ListNetInterfaces: {
+            sampleNetStats();
             json interfaces_j = json::array();
-            for (const auto& iface : interfaces) {
-                interfaces_j.push_back({{"name", iface.name}, {"totalBytes", iface.totalBytes}});
+            for (const auto &slot : netSlots) {
+                if (!slot.present || slot.name == "lo") continue;
+                interfaces_j.push_back({{"name", slot.name}, {"totalBytes", slot.bytes.rxBytes + slot.bytes.txBytes}});
             }
             j_out["type"] = "NET_INTERFACE_LIST";
             j_out["interfaces"] = interfaces_j;
             send_json(j_out);
-        } else if (cmd == "NET_PING") {
-            std::string iface = j_in.value("interface", "");
-            auto now = std::chrono::steady_clock::now();
-            auto curr = getNetStat(iface);
-
+            break;
+        }
+        case Command::NetPing: {
+            // An unknown or vanished interface reports zeros.
+            std::string iface = req.string("interface");
+            sampleNetStats();
+            NetInterfaceSlot none{iface, false, {0, 0}, 0.0, 0.0};
+            const NetInterfaceSlot *slot = &none;
+            for (const auto &candidate : netSlots) {
+                if (candidate.present && candidate.name == iface) { slot = &candidate; break; }
+            }
+            j_out = netSlotToJson(*slot);
+            j_out.erase("name");
             j_out["type"] = "NET_STATS";
-
-            auto it = netStatCache.find(iface);
-            if (it != netStatCache.end()) {
-                auto& prev = it->second;
-                double elapsed = std::chrono::duration<double>(now - prev.timestamp).count();
-
-                if (elapsed > 0.0) {
-                    j_out["rxBytesPerSec"] = (curr.rxBytes - prev.rxBytes) / elapsed;
-                    j_out["txBytesPerSec"] = (curr.txBytes - prev.txBytes) / elapsed;
-                } else {
-                    j_out["rxBytesPerSec"] = 0;
-                    j_out["txBytesPerSec"] = 0;
-                }
-            } else {
-                j_out["rxBytesPerSec"] = 0;
-                j_out["txBytesPerSec"] = 0;
+            send_json(j_out);
+            break;
+        }
+        case Command::NetPingAll: {
+            sampleNetStats();
+            json interfaces_j = json::array();
+            for (const auto &slot : netSlots) {
+                if (slot.present) interfaces_j.push_back(netSlotToJson(slot));
             }
-
-            netStatCache[iface] = {curr.rxBytes, curr.txBytes, now};
-
-            j_out["rxBytes"] = curr.rxBytes;
-            j_out["txBytes"] = curr.txBytes;
+            j_out["type"] = "NET_STATS_ALL";
+            j_out["interfaces"] = std::move(interfaces_j);
             send_json(j_out);
-        } else {
-            log_line("Unknown command: " + cmd);
+            break;
+        }
+        case Command::WatchPid: {
+            // PROCESS_EXITED is pushed once the process is gone; a pid that
+            // has already exited fails here with ESRCH.
+            int pid = (int)req.integer("pid", -1);
+            int err = watchPid(pid);
+            j_out["type"] = "WATCH_PID";
+            j_out["pid"] = pid;
+            j_out["success"] = err == 0;
+            if (err != 0) j_out["errno"] = err;
+            send_json(j_out);
+            break;
+        }
+        case Command::UnwatchPid: {
+            unwatchPid((int)req.integer("pid", -1));
+            break;
+        }
+        case Command::Unknown:
+            log_line("Unknown command: " + std::string(cmd));
+            break;
         }
     } catch (const std::exception& e) {
         log_line("JSON parse error: " + std::string(e.what()) + " | Data: " + received);
     }
 }
 
+// Reads what is available on stdin and runs every complete line. Returns
+// false once stdin is closed or fails.
+// Runs the complete lines in recv_buffer. A single FORCE_STOP answers with the
+// same KILL_RESULT type as KILL, so lines after it stay buffered until its
+// reply has been sent; this keeps replies in request order without blocking
+// the event loop.
+static void runCommands(std::string &recv_buffer) {
+    size_t pos;
+    while (!forceStopHoldsCommands() && (pos = recv_buffer.find('\n')) != std::string::npos) {
+        std::string message = recv_buffer.substr(0, pos);
+        recv_buffer.erase(0, pos + 1);
+        if (!message.empty()) processCommand(message);
+    }
+}
+
+static bool readCommands(char *buf, size_t size, std::string &recv_buffer) {
+    ssize_t r = read(STDIN_FILENO, buf, size);
+    if (r < 0) return errno == EINTR;
+    if (r == 0) return false;
+
+    recv_buffer.append(buf, r);
+    runCommands(recv_buffer);
+    return true;
+}
+
+static bool addToEpoll(int fd, EventTag tag) {
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = eventData(tag);
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
 int main() {
-    signal(SIGINT, handle_sigint);
-    signal(SIGTERM, handle_sigint);
+    // SIGINT/SIGTERM and SIGCHLD from force-stop children are read from a
+    // signalfd, so block them before any thread starts and inherits the mask.
+    sigset_t loopSignals;
+    sigemptyset(&loopSignals);
+    sigaddset(&loopSignals, SIGINT);
+    sigaddset(&loopSignals, SIGTERM);
+    sigaddset(&loopSignals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &loopSignals, nullptr);
     signal(SIGPIPE, SIG_IGN);
 
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int signalFd = signalfd(-1, &loopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    subscription.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epollFd < 0 || signalFd < 0 || subscription.timerFd < 0) {
+        log_line("Event loop setup failed: " + std::string(strerror(errno)));
+        return 1;
+    }
+    if (!addToEpoll(STDIN_FILENO, EVENT_STDIN) || !addToEpoll(signalFd, EVENT_SIGNAL) ||
+        !addToEpoll(subscription.timerFd, EVENT_SUBSCRIPTION_TIMER)) {
+        log_line("Cannot poll stdin: " + std::string(strerror(errno)));
+        return 1;
+    }
+    fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
+
+    cpuSampler.start();
+
     const size_t BUF_SIZE = 8192;
     std::unique_ptr<char[]> buf(new char[BUF_SIZE]);
     std::string recv_buffer;
 
+    constexpr int MAX_EVENTS = 16;
+    struct epoll_event events[MAX_EVENTS];
     while (keep_running) {
-        ssize_t r = read(STDIN_FILENO, buf.get(), BUF_SIZE - 1);
-        if (r > 0) {
-            buf[r] = '\0';
-            recv_buffer.append(buf.get(), r);
-            size_t pos;
-            while ((pos = recv_buffer.find('\n')) != std::string::npos) {
-                std::string message = recv_buffer.substr(0, pos);
-                recv_buffer.erase(0, pos + 1);
-                if (!message.empty()) processCommand(message);
+        int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n && keep_running; ++i) {
+            auto tag = (EventTag)(events[i].data.u64 >> 32);
+            auto value = (uint32_t)events[i].data.u64;
+            switch (tag) {
+                case EVENT_STDIN:
+                    if (!readCommands(buf.get(), BUF_SIZE, recv_buffer)) keep_running = false;
+                    break;
+                case EVENT_STDOUT:
+                    flushOutputQueue();
+                    break;
+                case EVENT_PIDFD:
+                    handlePidExit((int)value);
+                    break;
+                case EVENT_SUBSCRIPTION_TIMER:
+                    onSubscriptionTimer();
+                    break;
+                case EVENT_SIGNAL: {
+                    struct signalfd_siginfo info;
+                    while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+                        if (info.ssi_signo == SIGCHLD) {
+                            reapForceStops();
+                            runCommands(recv_buffer);
+                        } else {
+                            keep_running = false;
+                        }
+                    }
+                    break;
+                }
             }
-        } else if (r == 0) {
-            break;
-        } else {
-            if (errno == EINTR) continue;
-            break;
         }
+        if (outputQueue.broken) break;
+    }
+
+    // Give queued replies a last chance to reach the app before exiting, but
+    // only for a moment: a reader that has stopped draining stdout must not
+    // keep the daemon alive after SIGTERM.
+    const char *data = outputQueue.pending.data() + outputQueue.offset;
+    size_t size = outputQueue.broken ? 0 : outputQueue.size();
+    auto flushDeadline = std::chrono::steady_clock::now() + OutputQueue::FINAL_FLUSH_TIMEOUT;
+    while (size > 0 && writeNonBlocking(data, size) && size > 0) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(flushDeadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) break;
+        struct pollfd pfd = {STDOUT_FILENO, POLLOUT, 0};
+        int r = poll(&pfd, 1, (int)left.count());
+        if (r == 0 || (r < 0 && errno != EINTR)) break;
+    }
+    if (outputQueue.droppedSamples > 0) {
+        log_line("Dropped " + std::to_string(outputQueue.droppedSamples) + " samples for a slow reader");
     }
 
+    for (const auto &entry : watchedPids) close(entry.second);
+    for (const auto &entry : procDirCache) close(entry.second);
+    cpuSampler.stop();
+    close(subscription.timerFd);
+    close(signalFd);
+    close(epollFd);
     return 0;
 }
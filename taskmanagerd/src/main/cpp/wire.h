@@ -0,0 +1,81 @@
+#pragma once
+
+// Binary framing used after a client negotiates it with HELLO. Every frame is
+//
+//   u32 length | u8 type | u8 version | payload
+//
+// where length counts everything after itself. All integers are little-endian
+// and strings are a u16 byte length followed by UTF-8 bytes (no terminator).
+// Requests still arrive as newline-delimited JSON; only daemon output is
+// framed.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "wire format assumes a little-endian host");
+
+enum WireProtocol {
+    WIRE_JSON,
+    WIRE_BINARY,
+};
+
+static constexpr int WIRE_VERSION = 1;
+
+enum FrameType : uint8_t {
+    // Payload is one JSON message, for replies without a compact layout.
+    FRAME_JSON = 0x01,
+    // u32 field mask | u32 total | u32 count | count records. Each record
+    // holds the masked fields in ProcField bit order: pid i32, name str,
+    // nice i32, uid i32, cpuUsage f32, parentPid i32, isForeground u8,
+    // memoryUsageKb i64, cmdLine str, state u8 (the kernel state letter),
+    // threads i32, startTime i64, elapsedTime f32, residentSetSizeKb i64,
+    // virtualMemoryKb i64, cgroup str, executablePath str.
+    FRAME_PROCESS_LIST = 0x02,
+    // u64 seq | u32 metric mask | the masked metrics in Metric bit order:
+    // cpu i32, perCoreCpu u8 count + count i8, swap i64 used + i64 total,
+    // gpu i32, cpuTemp i32, pidCpu i32 pid + f32 usage, meminfo u8 count +
+    // count i64 kB in MEMINFO_FIELDS order + i64 zram orig, compressed, used
+    // kB (-1 for anything the kernel does not report).
+    FRAME_SAMPLES = 0x03,
+};
+
+// Accumulates one frame in a reusable buffer; finish() patches the length.
+class FrameWriter {
+public:
+    void begin(FrameType type) {
+        buf_.clear();
+        buf_.append(4, '\0');
+        putU8(type);
+        putU8(WIRE_VERSION);
+    }
+
+    void putU8(uint8_t v) { buf_.push_back(static_cast<char>(v)); }
+    void putI8(int8_t v) { putU8(static_cast<uint8_t>(v)); }
+    void putU16(uint16_t v) { putRaw(&v, sizeof(v)); }
+    void putU32(uint32_t v) { putRaw(&v, sizeof(v)); }
+    void putI32(int32_t v) { putRaw(&v, sizeof(v)); }
+    void putU64(uint64_t v) { putRaw(&v, sizeof(v)); }
+    void putI64(int64_t v) { putRaw(&v, sizeof(v)); }
+    void putF32(float v) { putRaw(&v, sizeof(v)); }
+
+    void putStr(const std::string &s) {
+        uint16_t len = static_cast<uint16_t>(std::min<size_t>(s.size(), UINT16_MAX));
+        putU16(len);
+        buf_.append(s.data(), len);
+    }
+
+    void putBytes(const std::string &s) { buf_.append(s); }
+
+    const std::string &finish() {
+        uint32_t len = static_cast<uint32_t>(buf_.size() - 4);
+        memcpy(&buf_[0], &len, sizeof(len));
+        return buf_;
+    }
+
+private:
+    void putRaw(const void *p, size_t n) { buf_.append(static_cast<const char *>(p), n); }
+
+    std::string buf_;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+// Small persistent thread pool for fanning a /proc scan out over a few cores.
+// Each participant (the workers plus the calling thread) starts on its own
+// contiguous slice of the index range and claims chunks from it; once its
+// slice is drained it steals chunks from the others' slices, so one slow
+// process (a huge cmdline, a D-state task) does not hold up the whole scan.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    static constexpr size_t CHUNK = 8;
+
+    explicit WorkerPool(unsigned workers) {
+        slices_.reset(new Slice[workers + 1]);
+        for (unsigned i = 0; i < workers; ++i) threads_.emplace_back(&WorkerPool::run, this, i + 1);
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto &t : threads_) t.join();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Number of threads taking part in parallelFor, including the caller.
+    unsigned participants() const { return static_cast<unsigned>(threads_.size()) + 1; }
+
+    // Calls fn(index) once for every index in [0, count) and returns when all
+    // calls have finished. fn must be safe to run concurrently for different
+    // indices. Not reentrant.
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn) {
+        unsigned n = participants();
+        size_t per = (count + n - 1) / n;
+        for (unsigned i = 0; i < n; ++i) {
+            size_t begin = std::min(count, per * i);
+            slices_[i].next.store(begin, std::memory_order_relaxed);
+            slices_[i].end = std::min(count, begin + per);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fn_ = &fn;
+            busy_ = static_cast<unsigned>(threads_.size());
+            generation_++;
+        }
+        wake_.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_ == 0; });
+        fn_ = nullptr;
+    }
+
+private:
+    struct alignas(64) Slice {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+    };
+
+    void work(unsigned self) {
+        unsigned n = participants();
+        for (unsigned k = 0; k < n; ++k) {
+            Slice &slice = slices_[(self + k) % n];
+            for (;;) {
+                size_t begin = slice.next.fetch_add(CHUNK, std::memory_order_relaxed);
+                if (begin >= slice.end) break;
+                size_t end = std::min(slice.end, begin + CHUNK);
+                for (size_t i = begin; i < end; ++i) (*fn_)(i);
+            }
+        }
+    }
+
+    void run(unsigned self) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stopping_ || generation_ != seen; });
+                if (stopping_) return;
+                seen = generation_;
+            }
+            work(self);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--busy_ == 0) done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Slice[]> slices_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)> *fn_ = nullptr;
+    uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+    bool stopping_ = false;
+};